@@ -1,16 +1,265 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <map>
-#include <set>
 #include <algorithm>
 #include <unordered_map>
 #include <functional>
 #include <sstream>
 #include <cctype>
+#include <array>
+#include <memory_resource>
+#include <string_view>
+#include <charconv>
+#include <memory>
+#include <type_traits>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <climits>
+#include <deque>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
+// Upper bound on the number of problems in a competition (A..Z)
+const int MAX_PROBLEMS = 26;
+// Wildcard for query filters
+const int ANY = -1;
+// Upper bound on the number of operations in a competition
+const size_t MAX_OPERATIONS = 300000;
+// Expected submissions per (team, problem) cell, used to presize the log
+const size_t SUBMISSIONS_PER_CELL = 2;
+// First block requested by a contest arena; later blocks grow geometrically
+const size_t ARENA_INITIAL_BYTES = 64 * 1024;
+// Most SUBMIT commands collected before they are ingested as one batch
+const size_t SUBMIT_BATCH_LIMIT = 4096;
+
+// Append-only text buffer the engine renders its responses into. The
+// front-end decides where and when the bytes are written, which lets one
+// process serve several contests through the same output path.
+class OutputBuffer {
+public:
+    OutputBuffer& operator<<(string_view text) {
+        data.append(text);
+        return *this;
+    }
+
+    OutputBuffer& operator<<(char c) {
+        data.push_back(c);
+        return *this;
+    }
+
+    template <typename T, typename = enable_if_t<is_integral_v<T>>>
+    OutputBuffer& operator<<(T value) {
+        char digits[24];
+        auto result = to_chars(digits, digits + sizeof(digits), value);
+        data.append(digits, result.ptr);
+        return *this;
+    }
+
+    const string& str() const { return data; }
+    size_t size() const { return data.size(); }
+    bool empty() const { return data.empty(); }
+    void clear() { data.clear(); }
+    void swap(OutputBuffer& other) { data.swap(other.data); }
+
+    // Extend the buffer by up to n bytes to be written in place; finish with
+    // trimTo() passing the end of what was actually written
+    char* appendSpace(size_t n) {
+        size_t used = data.size();
+        data.resize(used + n);
+        return &data[used];
+    }
+
+    void trimTo(const char* end) {
+        data.resize(end - data.data());
+    }
+
+    // Write the buffered bytes to a stdio stream and empty the buffer
+    void writeTo(FILE* stream) {
+        fwrite(data.data(), 1, data.size(), stream);
+        data.clear();
+    }
+
+private:
+    string data;
+};
+
+// Splits a command line into whitespace-separated tokens without copying
+class Tokenizer {
+public:
+    explicit Tokenizer(string_view text) : rest(text) {}
+
+    string_view next() {
+        size_t begin = 0;
+        while (begin < rest.size() && isspace(static_cast<unsigned char>(rest[begin]))) ++begin;
+        size_t end = begin;
+        while (end < rest.size() && !isspace(static_cast<unsigned char>(rest[end]))) ++end;
+        string_view token = rest.substr(begin, end - begin);
+        rest.remove_prefix(end);
+        return token;
+    }
+
+    int nextInt() {
+        string_view token = next();
+        int value = 0;
+        from_chars(token.data(), token.data() + token.size(), value);
+        return value;
+    }
+
+    // Everything after the tokens consumed so far
+    string_view remainder() const { return rest; }
+
+private:
+    string_view rest;
+};
+
+// Scoreboard row layout bounds, used to reserve output space per row
+const size_t INT_MAX_DIGITS = 11;
+const size_t ROW_FIXED_BYTES = 3 * (INT_MAX_DIGITS + 1) + 1; // rank, solved, penalty, newline
+const size_t CELL_MAX_BYTES = 2 * INT_MAX_DIGITS + 3; // " -x/y"
+
+// Glyph of a single-character cell, indexed by whether the problem is solved
+const char SIMPLE_CELL_GLYPHS[2] = {'.', '+'};
+
+// Bit p of the result is set when counts[p] == 0, for p < MAX_PROBLEMS.
+// Vector versions are picked at startup from the CPU's features.
+uint32_t zeroCountsScalar(const int* counts) {
+    uint32_t mask = 0;
+    for (int i = 0; i < MAX_PROBLEMS; ++i) {
+        if (counts[i] == 0) mask |= 1u << i;
+    }
+    return mask;
+}
+
+#if defined(__x86_64__)
+static_assert(MAX_PROBLEMS == 26, "vector kernels cover exactly 26 lanes");
+
+// Lanes 24 and 25
+inline uint32_t zeroCountsTail(const int* counts) {
+    __m128i tail = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(counts + 24));
+    __m128i equal = _mm_cmpeq_epi32(tail, _mm_setzero_si128());
+    return (static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(equal))) & 0x3u) << 24;
+}
+
+uint32_t zeroCountsSse2(const int* counts) {
+    uint32_t mask = zeroCountsTail(counts);
+    for (int i = 0; i < 24; i += 4) {
+        __m128i lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i));
+        __m128i equal = _mm_cmpeq_epi32(lanes, _mm_setzero_si128());
+        mask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(equal))) << i;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2"))) uint32_t zeroCountsAvx2(const int* counts) {
+    uint32_t mask = zeroCountsTail(counts);
+    for (int i = 0; i < 24; i += 8) {
+        __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + i));
+        __m256i equal = _mm256_cmpeq_epi32(lanes, _mm256_setzero_si256());
+        mask |= static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(equal))) << i;
+    }
+    return mask;
+}
+#endif
+
+uint32_t (*selectZeroCounts())(const int*) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return zeroCountsAvx2;
+    return zeroCountsSse2;
+#else
+    return zeroCountsScalar;
+#endif
+}
+
+uint32_t (*const zeroCounts)(const int*) = selectZeroCounts();
+
+// A team's ranking fields laid out so that comparing keys byte by byte
+// compares the teams: ~solvedCount, penaltyTime and the solve times
+// (descending, zero padded) as big-endian 32-bit lanes, then the name,
+// zero padded. Names are unique and shorter than the name part, so no two
+// teams have equal keys. The key with the smaller first differing byte ranks higher.
+const size_t KEY_NAME_BYTES = 32;
+const size_t RANK_KEY_BYTES = 4 * (2 + MAX_PROBLEMS) + KEY_NAME_BYTES;
+static_assert(RANK_KEY_BYTES % 16 == 0, "rank keys are compared in 16-byte blocks");
+
+struct alignas(16) RankKey {
+    uint8_t bytes[RANK_KEY_BYTES];
+
+    void setLane(int lane, uint32_t value) {
+        bytes[4 * lane] = static_cast<uint8_t>(value >> 24);
+        bytes[4 * lane + 1] = static_cast<uint8_t>(value >> 16);
+        bytes[4 * lane + 2] = static_cast<uint8_t>(value >> 8);
+        bytes[4 * lane + 3] = static_cast<uint8_t>(value);
+    }
+};
+
+// Negative, zero or positive as key a orders before, equal to or after b
+int compareKeysScalar(const RankKey& a, const RankKey& b) {
+    return memcmp(a.bytes, b.bytes, RANK_KEY_BYTES);
+}
+
+#if defined(__x86_64__)
+// Order of two keys given the equality mask of the block at offset
+inline int compareAtFirstDifference(const RankKey& a, const RankKey& b, size_t offset, uint32_t different) {
+    size_t i = offset + __builtin_ctz(different);
+    return static_cast<int>(a.bytes[i]) - static_cast<int>(b.bytes[i]);
+}
+
+int compareKeysSse2(const RankKey& a, const RankKey& b) {
+    for (size_t offset = 0; offset < RANK_KEY_BYTES; offset += 16) {
+        __m128i x = _mm_load_si128(reinterpret_cast<const __m128i*>(a.bytes + offset));
+        __m128i y = _mm_load_si128(reinterpret_cast<const __m128i*>(b.bytes + offset));
+        uint32_t different = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) & 0xFFFFu;
+        if (different != 0) return compareAtFirstDifference(a, b, offset, different);
+    }
+    return 0;
+}
+
+__attribute__((target("avx2"))) int compareKeysAvx2(const RankKey& a, const RankKey& b) {
+    size_t offset = 0;
+    for (; offset + 32 <= RANK_KEY_BYTES; offset += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.bytes + offset));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b.bytes + offset));
+        uint32_t different = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+        if (different != 0) return compareAtFirstDifference(a, b, offset, different);
+    }
+    for (; offset < RANK_KEY_BYTES; offset += 16) {
+        __m128i x = _mm_load_si128(reinterpret_cast<const __m128i*>(a.bytes + offset));
+        __m128i y = _mm_load_si128(reinterpret_cast<const __m128i*>(b.bytes + offset));
+        uint32_t different = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) & 0xFFFFu;
+        if (different != 0) return compareAtFirstDifference(a, b, offset, different);
+    }
+    return 0;
+}
+#endif
+
+int (*selectCompareKeys())(const RankKey&, const RankKey&) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return compareKeysAvx2;
+    return compareKeysSse2;
+#else
+    return compareKeysScalar;
+#endif
+}
+
+int (*const compareKeys)(const RankKey&, const RankKey&) = selectCompareKeys();
+
 // Judge status enumeration
 enum class Status {
     ACCEPTED,
@@ -20,7 +269,7 @@ enum class Status {
 };
 
 // Convert string to Status
-Status stringToStatus(const string& statusStr) {
+Status stringToStatus(string_view statusStr) {
     if (statusStr == "Accepted") return Status::ACCEPTED;
     if (statusStr == "Wrong_Answer") return Status::WRONG_ANSWER;
     if (statusStr == "Runtime_Error") return Status::RUNTIME_ERROR;
@@ -40,474 +289,2265 @@ string statusToString(Status status) {
 }
 
 struct Submission {
-    string teamName;
-    string problemName;
+    int teamId;
+    int problem; // problem index, 0 = 'A'
     Status status;
     int time;
+    int previousByTeam; // log offset of the team's previous submission, -1 if none
+    int previousOnProblem; // the same, restricted to this problem
+    int previousOfProblem; // log offset of the previous submission to this problem by any team
+
+    Submission(int team, int prob, Status stat, int t)
+        : teamId(team), problem(prob), status(stat), time(t), previousByTeam(-1), previousOnProblem(-1),
+          previousOfProblem(-1) {}
+};
+
+// First log offset holding a submission at the given time. The log keeps
+// one mark per distinct time, in log order.
+struct TimeMark {
+    int time;
+    int offset;
+};
+
+// Log offsets [start, end) of the submissions made during one freeze; end
+// is -1 while the board is still frozen
+struct FreezePeriod {
+    int start;
+    int end;
+};
+
+// A team name stored inline. Names are at most 20 characters, so the bytes
+// (zero padded) and the length fit in three 64-bit words, and equality,
+// ordering and hashing work on those words instead of on characters.
+struct alignas(8) TeamName {
+    static constexpr size_t CAPACITY = 23;
+
+    char bytes[CAPACITY];
+    uint8_t length;
+
+    TeamName() : bytes(), length(0) {}
+
+    // The name must fit, see fits()
+    explicit TeamName(string_view name) : bytes(), length(static_cast<uint8_t>(name.size())) {
+        memcpy(bytes, name.data(), name.size());
+    }
+
+    static bool fits(string_view name) { return name.size() <= CAPACITY; }
+
+    string_view view() const { return string_view(bytes, length); }
+    size_t size() const { return length; }
+    const char* begin() const { return bytes; }
+    const char* end() const { return bytes + length; }
+
+    // Word i of the whole object; the last word ends with the length byte
+    uint64_t word(int i) const {
+        uint64_t value;
+        memcpy(&value, reinterpret_cast<const char*>(this) + 8 * i, 8);
+        return value;
+    }
+
+    // Word i with its first byte most significant, so words order like strings
+    uint64_t orderedWord(int i) const {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return __builtin_bswap64(word(i));
+#else
+        return word(i);
+#endif
+    }
+
+    uint64_t hash() const {
+        uint64_t h = (word(0) * 0x9E3779B97F4A7C15ull) ^ (word(1) * 0xC2B2AE3D27D4EB4Full) ^
+                     (word(2) * 0x165667B19E3779F9ull);
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    friend bool operator==(const TeamName& a, const TeamName& b) {
+        return ((a.word(0) ^ b.word(0)) | (a.word(1) ^ b.word(1)) | (a.word(2) ^ b.word(2))) == 0;
+    }
 
-    Submission(const string& team, const string& problem, Status stat, int t)
-        : teamName(team), problemName(problem), status(stat), time(t) {}
+    // Zero padding sorts before every name character, so this is string order
+    friend bool operator<(const TeamName& a, const TeamName& b) {
+        for (int i = 0; i < 3; ++i) {
+            uint64_t x = a.orderedWord(i), y = b.orderedWord(i);
+            if (x != y) return x < y;
+        }
+        return false;
+    }
 };
+static_assert(sizeof(TeamName) == 24, "team names are three words");
+static_assert(offsetof(TeamName, length) == TeamName::CAPACITY, "the length byte ends the last word");
+static_assert(TeamName::CAPACITY <= KEY_NAME_BYTES, "rank keys hold whole names");
 
+// Per-team state. All per-problem counters are fixed-size arrays indexed by
+// problem, so a Team owns no heap memory and is trivially destructible.
 struct Team {
-    string name;
+    TeamName name;
     int solvedCount;
     int penaltyTime;
-    map<string, int> wrongSubmissions; // problem -> wrong submission count before first AC
-    map<string, int> firstAcceptTime; // problem -> first AC time
-    map<string, bool> isSolved; // problem -> whether solved
-    map<string, int> totalSubmissions; // problem -> total submissions
-    map<string, int> frozenSubmissions; // problem -> submissions after freeze
+    array<int, MAX_PROBLEMS> wrongSubmissions; // wrong submission count before first AC
+    array<int, MAX_PROBLEMS> firstAcceptTime; // first AC time
+    array<int, MAX_PROBLEMS> totalSubmissions; // total submissions
+    array<int, MAX_PROBLEMS> frozenSubmissions; // submissions after freeze
+    array<int, MAX_PROBLEMS> frozenAcceptTime; // first AC time after freeze, 0 if none
+    array<int, MAX_PROBLEMS> solveTimes; // first solvedCount entries, descending
+    uint32_t solvedMask; // bit p set once problem p is solved
+    uint32_t frozenMask; // bit p set while problem p is frozen
+    bool rankingDirty; // ranking fields changed since the last sort
+    bool rowStale; // rendered cells changed since the row was cached
+    RankKey rankKey; // kept in step with the ranking fields
+    int lastSubmission; // log offset of the newest submission, -1 if none
+    array<int, MAX_PROBLEMS> lastOnProblem; // the same per problem
+    bool disqualified; // kept for audit, ranked below every other team and not shown
+
+    explicit Team(const TeamName& n)
+        : name(n), solvedCount(0), penaltyTime(0), wrongSubmissions(), firstAcceptTime(),
+          totalSubmissions(), frozenSubmissions(), frozenAcceptTime(), solveTimes(),
+          solvedMask(0), frozenMask(0), rankingDirty(false), rowStale(true), rankKey(),
+          lastSubmission(-1), disqualified(false) {
+        lastOnProblem.fill(-1);
+        copy_n(name.bytes, TeamName::CAPACITY, rankKey.bytes + RANK_KEY_BYTES - KEY_NAME_BYTES);
+        refreshRankKey();
+    }
 
-    Team() : name(""), solvedCount(0), penaltyTime(0) {}
-    Team(const string& n) : name(n), solvedCount(0), penaltyTime(0) {}
+    bool isSolved(int problem) const {
+        return solvedMask & (1u << problem);
+    }
 
     // Get penalty time for a problem
-    int getProblemPenalty(const string& problem) const {
-        if (!isSolved.at(problem)) return 0;
-        return 20 * wrongSubmissions.at(problem) + firstAcceptTime.at(problem);
+    int getProblemPenalty(int problem) const {
+        if (!isSolved(problem)) return 0;
+        return 20 * wrongSubmissions[problem] + firstAcceptTime[problem];
     }
 
     // Get maximum solve time
     int getMaxSolveTime() const {
-        int maxTime = 0;
-        for (const auto& [problem, solved] : isSolved) {
-            if (solved) {
-                maxTime = max(maxTime, firstAcceptTime.at(problem));
+        return solvedCount > 0 ? solveTimes[0] : 0;
+    }
+
+    // Mark a problem as solved at the given time and update the totals
+    void markSolved(int problem, int time) {
+        solvedMask |= 1u << problem;
+        firstAcceptTime[problem] = time;
+
+        // Insert into solveTimes keeping descending order
+        int i = solvedCount;
+        while (i > 0 && solveTimes[i - 1] < time) {
+            solveTimes[i] = solveTimes[i - 1];
+            --i;
+        }
+        solveTimes[i] = time;
+
+        solvedCount++;
+        penaltyTime += getProblemPenalty(problem);
+        rowStale = true;
+        refreshRankKey();
+    }
+
+    // Take a solved problem back out of the totals
+    void unmarkSolved(int problem) {
+        penaltyTime -= getProblemPenalty(problem);
+        auto times = solveTimes.begin();
+        auto at = find(times, times + solvedCount, firstAcceptTime[problem]);
+        copy(at + 1, times + solvedCount, at);
+        solvedCount--;
+        solveTimes[solvedCount] = 0;
+
+        solvedMask &= ~(1u << problem);
+        firstAcceptTime[problem] = 0;
+        rowStale = true;
+        refreshRankKey();
+    }
+
+    // Re-encode the numeric lanes of rankKey
+    void refreshRankKey() {
+        if (disqualified) {
+            // Below every team that is still ranked; the name orders the rest
+            for (int i = 0; i < 2 + MAX_PROBLEMS; ++i) rankKey.setLane(i, UINT32_MAX);
+            return;
+        }
+        rankKey.setLane(0, ~static_cast<uint32_t>(solvedCount));
+        rankKey.setLane(1, static_cast<uint32_t>(penaltyTime));
+        for (int i = 0; i < MAX_PROBLEMS; ++i) {
+            rankKey.setLane(2 + i, i < solvedCount ? static_cast<uint32_t>(solveTimes[i]) : 0);
+        }
+    }
+};
+
+// Team name -> team id, as a flat open-addressing table probed a group of
+// 16 slots at a time: one control byte per slot holds 7 bits of the name's
+// hash (or EMPTY), and the whole group is matched with one SIMD compare.
+// Slots hold the name inline, so a lookup normally touches one control
+// group and one slot. Names are only ever added, so there are no tombstones.
+const size_t NAME_GROUP_SLOTS = 16;
+
+class NameIndex {
+    static constexpr uint8_t EMPTY = 0x80;
+
+    struct Slot {
+        TeamName name;
+        int32_t id;
+    };
+
+    pmr::vector<uint8_t> control;
+    pmr::vector<Slot> slots;
+    size_t groupMask; // group count - 1, a power of two less one
+    size_t used;
+
+public:
+    explicit NameIndex(pmr::memory_resource* resource)
+        : control(resource), slots(resource), groupMask(0), used(0) {
+        resize(1);
+    }
+
+    // Id of the name, or -1 if it was never inserted
+    int find(const TeamName& name) const {
+        uint64_t hash = name.hash();
+        uint8_t tag = static_cast<uint8_t>(hash & 0x7F);
+        size_t group = (hash >> 7) & groupMask;
+
+        for (size_t step = 1;; ++step) {
+            for (uint32_t match = matchGroup(group, tag); match != 0; match &= match - 1) {
+                const Slot& slot = slots[group * NAME_GROUP_SLOTS + __builtin_ctz(match)];
+                if (slot.name == name) return slot.id;
+            }
+            if (matchGroup(group, EMPTY) != 0) return -1;
+            group = (group + step) & groupMask;
+        }
+    }
+
+    // Add a name that is not in the index yet
+    void insert(const TeamName& name, int id) {
+        if ((used + 1) * 8 > control.size() * 7) resize(2 * (groupMask + 1));
+        place(Slot{name, id});
+        used++;
+    }
+
+private:
+    // Bit i set if control byte i of the group equals tag
+    uint32_t matchGroup(size_t group, uint8_t tag) const {
+        const uint8_t* bytes = control.data() + group * NAME_GROUP_SLOTS;
+#if defined(__x86_64__)
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(tag)))));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < NAME_GROUP_SLOTS; ++i) {
+            if (bytes[i] == tag) mask |= 1u << i;
+        }
+        return mask;
+#endif
+    }
+
+    // Put a slot in the first empty place along its probe sequence
+    void place(const Slot& slot) {
+        uint64_t hash = slot.name.hash();
+        size_t group = (hash >> 7) & groupMask;
+        for (size_t step = 1;; ++step) {
+            uint32_t empty = matchGroup(group, EMPTY);
+            if (empty != 0) {
+                size_t index = group * NAME_GROUP_SLOTS + __builtin_ctz(empty);
+                control[index] = static_cast<uint8_t>(hash & 0x7F);
+                slots[index] = slot;
+                return;
             }
+            group = (group + step) & groupMask;
+        }
+    }
+
+    void resize(size_t groupCount) {
+        pmr::vector<uint8_t> oldControl(move(control));
+        pmr::vector<Slot> oldSlots(move(slots));
+
+        groupMask = groupCount - 1;
+        control.assign(groupCount * NAME_GROUP_SLOTS, EMPTY);
+        slots.resize(groupCount * NAME_GROUP_SLOTS);
+        for (size_t i = 0; i < oldControl.size(); ++i) {
+            if (oldControl[i] != EMPTY) place(oldSlots[i]);
         }
-        return maxTime;
     }
+};
+
+// Minimal perfect hash over a fixed set of names (hash and displace, CHD
+// style): a name's hash picks a bucket, and the bucket's displacement picks
+// the name's slot among exactly as many slots as there are names. Buckets
+// are placed largest first while the table is still empty, by trying seeds
+// until all their names land on free, distinct slots; single-name buckets
+// then take the remaining slots directly. A lookup is one hash and two
+// table reads, and yields the only id the name can have, which the caller
+// confirms with one compare.
+const size_t NAMES_PER_BUCKET = 4;
+const uint32_t MAX_BUCKET_SEEDS = 1 << 16;
+
+class PerfectNameHash {
+    static constexpr uint32_t DIRECT_SLOT = 0x80000000u; // displacement is the slot itself
+
+    pmr::vector<uint32_t> displacement; // per bucket
+    pmr::vector<int> ids; // slot -> id
+
+public:
+    explicit PerfectNameHash(pmr::memory_resource* resource) : displacement(resource), ids(resource) {}
+
+    // Number of names covered, 0 until build succeeds
+    size_t size() const { return ids.size(); }
+
+    // Build over names, where names[i] gets id i. Returns false, leaving the
+    // hash empty, if some bucket cannot be placed (only if names collide on
+    // their 64-bit hash).
+    bool build(const vector<TeamName>& names) {
+        size_t count = names.size();
+        size_t bucketCount = count / NAMES_PER_BUCKET + 1;
+        ids.clear();
+        displacement.assign(bucketCount, 0);
+        if (count == 0) return true;
+
+        // Group the names by bucket, then visit the buckets largest first
+        vector<uint64_t> hashes(count);
+        vector<int> bucketStart(bucketCount + 1, 0);
+        for (size_t i = 0; i < count; ++i) {
+            hashes[i] = names[i].hash();
+            bucketStart[bucketOf(hashes[i], bucketCount) + 1]++;
+        }
+        for (size_t b = 0; b < bucketCount; ++b) bucketStart[b + 1] += bucketStart[b];
+        vector<int> members(count);
+        vector<int> fill(bucketStart.begin(), bucketStart.end() - 1);
+        for (size_t i = 0; i < count; ++i) members[fill[bucketOf(hashes[i], bucketCount)]++] = static_cast<int>(i);
+
+        vector<int> buckets(bucketCount);
+        for (size_t b = 0; b < bucketCount; ++b) buckets[b] = static_cast<int>(b);
+        stable_sort(buckets.begin(), buckets.end(), [&](int a, int b) {
+            return bucketStart[a + 1] - bucketStart[a] > bucketStart[b + 1] - bucketStart[b];
+        });
+
+        vector<int> slotIds(count, -1);
+        vector<size_t> placed;
+        size_t next = 0;
+        for (int bucket : buckets) {
+            int first = bucketStart[bucket], last = bucketStart[bucket + 1];
+            if (last - first == 0) break;
+
+            if (last - first == 1) {
+                // Any free slot will do; store it directly
+                while (slotIds[next] != -1) ++next;
+                slotIds[next] = members[first];
+                displacement[bucket] = DIRECT_SLOT | static_cast<uint32_t>(next);
+                continue;
+            }
 
-    // Get solve times in descending order
-    vector<int> getSolveTimes() const {
-        vector<int> times;
-        for (const auto& [problem, solved] : isSolved) {
-            if (solved) {
-                times.push_back(firstAcceptTime.at(problem));
+            bool done = false;
+            for (uint32_t seed = 0; seed < MAX_BUCKET_SEEDS && !done; ++seed) {
+                placed.clear();
+                done = true;
+                for (int i = first; i < last; ++i) {
+                    size_t slot = slotOf(hashes[members[i]], seed, count);
+                    if (slotIds[slot] != -1) {
+                        done = false;
+                        break;
+                    }
+                    slotIds[slot] = members[i];
+                    placed.push_back(slot);
+                }
+                if (done) {
+                    displacement[bucket] = seed;
+                } else {
+                    for (size_t slot : placed) slotIds[slot] = -1;
+                }
+            }
+            if (!done) {
+                displacement.clear();
+                return false;
             }
         }
-        sort(times.rbegin(), times.rend());
-        return times;
+
+        ids.assign(slotIds.begin(), slotIds.end());
+        return true;
+    }
+
+    // The only id name can have, or -1 if the hash is empty
+    int candidate(const TeamName& name) const {
+        if (ids.empty()) return -1;
+        uint64_t hash = name.hash();
+        uint32_t d = displacement[bucketOf(hash, displacement.size())];
+        size_t slot = (d & DIRECT_SLOT) ? d & ~DIRECT_SLOT : slotOf(hash, d, ids.size());
+        return ids[slot];
+    }
+
+private:
+    static uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // Scale 32 hash bits to [0, n) without a division
+    static size_t scale(uint64_t bits, size_t n) {
+        return static_cast<size_t>(((bits & 0xFFFFFFFFu) * n) >> 32);
+    }
+
+    static size_t bucketOf(uint64_t hash, size_t bucketCount) {
+        return scale(hash >> 32, bucketCount);
+    }
+
+    static size_t slotOf(uint64_t hash, uint32_t seed, size_t slotCount) {
+        return scale(mix(hash + seed * 0x9E3779B97F4A7C15ull), slotCount);
     }
 };
 
+// Immutable view of the ranking shown on the scoreboard. The engine publishes
+// a new snapshot whenever the visible ranking or freeze state changes; a
+// reader keeps using the snapshot it loaded for as long as it holds it, so
+// reads never wait for the writer to finish ingesting submissions.
+struct RankingSnapshot {
+    uint64_t version;
+    bool frozen;
+    vector<int> order; // team ids, best first
+    vector<int> rankOf; // team id -> 1-based rank, 0 if disqualified
+};
+
 class ICPCManagementSystem {
 private:
+    // All per-contest state below is allocated from this arena, so tearing a
+    // contest down is a single release. It must be declared first so that it
+    // outlives the containers built on it.
+    pmr::monotonic_buffer_resource arena;
+
     bool competitionStarted;
     bool isFrozen;
     int durationTime;
     int problemCount;
-    vector<string> problemNames;
 
-    map<string, Team> teams;
-    vector<Submission> submissions;
-    vector<string> teamOrder; // Current ranking order
+    pmr::vector<Team> teams; // indexed by team id (registration order)
+    NameIndex teamIds; // team name -> team id
+    PerfectNameHash registeredTeams; // the same for the teams registered before START
+    pmr::vector<Submission> submissions;
+    pmr::vector<TimeMark> timeIndex; // submission times are non-decreasing, so this is sorted
+    bool timeOrdered; // false once a submission arrived out of time order
+    pmr::vector<FreezePeriod> freezePeriods; // in log order
+    array<int, MAX_PROBLEMS> lastOfProblem; // log offset of the newest submission per problem
+    pmr::vector<int> teamOrder; // Current ranking order (team ids)
+    pmr::vector<int> rankPos; // team id -> index in teamOrder
+    bool rankingSorted; // teamOrder has been sorted at least once
+    pmr::vector<int> dirtyTeams; // teams whose ranking fields changed since the last sort
+    int disqualifiedCount; // disqualified teams fill the tail of teamOrder
+
+    // Scratch space reused across batches and flushes
+    pmr::vector<int> batchOrder;
+    pmr::vector<int> cleanOrder;
+
+    // Rendered scoreboard cells per team, one fixed-size slot each
+    pmr::vector<char> rowCache;
+    pmr::vector<int> rowLength;
+    size_t rowSlotBytes;
 
     // For scroll operation
-    map<string, set<string>> frozenProblems; // team -> set of frozen problems
+    bool scrollTrace; // report every scroll step
+    bool lateRegistration; // ADDTEAM is accepted after START
+    bool scrollInProgress; // between SCROLL_BEGIN and SCROLL_FINISH
+    pmr::vector<int> scrollQueue; // teams left to reveal, see buildScrollQueue
+
+    OutputBuffer& out; // responses are rendered here
+
+    // Latest published ranking, swapped atomically so other threads can read it
+    shared_ptr<const RankingSnapshot> published;
+    uint64_t rankingVersion;
+    bool rankingStale; // teams were added since the last publish
+    bool orderMoved; // teamOrder changed outside updateRankings since the last publish
 
 public:
-    ICPCManagementSystem() : competitionStarted(false), isFrozen(false), durationTime(0), problemCount(0) {}
+    explicit ICPCManagementSystem(OutputBuffer& output,
+                                  pmr::memory_resource* upstream = pmr::get_default_resource())
+        : arena(ARENA_INITIAL_BYTES, upstream), competitionStarted(false), isFrozen(false),
+          durationTime(0), problemCount(0), teams(&arena), teamIds(&arena), registeredTeams(&arena),
+          submissions(&arena), timeIndex(&arena), timeOrdered(true),
+          freezePeriods(&arena), teamOrder(&arena), rankPos(&arena), rankingSorted(false), dirtyTeams(&arena),
+          disqualifiedCount(0),
+          batchOrder(&arena), cleanOrder(&arena), rowCache(&arena), rowLength(&arena), rowSlotBytes(0),
+          scrollTrace(false), lateRegistration(false), scrollInProgress(false), scrollQueue(&arena), out(output), rankingVersion(0),
+          rankingStale(true), orderMoved(false) {
+        lastOfProblem.fill(-1);
+    }
 
-    void addTeam(const string& teamName) {
-        if (competitionStarted) {
-            cout << "[Error]Add failed: competition has started.\n";
+    ICPCManagementSystem(const ICPCManagementSystem&) = delete;
+    ICPCManagementSystem& operator=(const ICPCManagementSystem&) = delete;
+
+    void addTeam(string_view teamName) {
+        if (competitionStarted && !lateRegistration) {
+            out << "[Error]Add failed: competition has started.\n";
+            return;
+        }
+
+        // Names are stored inline, so longer names than the limit allows are refused
+        if (!TeamName::fits(teamName)) {
+            out << "[Error]Add failed: team name too long.\n";
             return;
         }
 
-        if (teams.find(teamName) != teams.end()) {
-            cout << "[Error]Add failed: duplicated team name.\n";
+        TeamName name(teamName);
+        if (teamIds.find(name) != -1) {
+            out << "[Error]Add failed: duplicated team name.\n";
             return;
         }
 
-        teams[teamName] = Team(teamName);
-        teamOrder.push_back(teamName);
-        cout << "[Info]Add successfully.\n";
+        int id = static_cast<int>(teams.size());
+        teams.emplace_back(name);
+        teamIds.insert(teams.back().name, id);
+        if (competitionStarted && rankingSorted && dirtyTeams.empty()) {
+            insertRanked(id);
+        } else {
+            // The next sort or merge places it
+            teamOrder.push_back(id);
+            rankPos.push_back(id);
+            markDirty(id);
+        }
+        if (competitionStarted && !rankingStale) {
+            // Ranked after the others until the next flush publishes its place
+            publishLateTeam(id);
+            orderMoved = true;
+        } else {
+            rankingStale = true;
+        }
+        out << "[Info]Add successfully.\n";
     }
 
     void startCompetition(int duration, int problemCnt) {
         if (competitionStarted) {
-            cout << "[Error]Start failed: competition has started.\n";
+            out << "[Error]Start failed: competition has started.\n";
             return;
         }
 
         durationTime = duration;
         problemCount = problemCnt;
 
-        // Generate problem names (A, B, C, ...)
-        problemNames.clear();
-        for (int i = 0; i < problemCount; ++i) {
-            problemNames.push_back(string(1, 'A' + i));
-        }
-
-        // Initialize all teams with problems
-        for (auto& [name, team] : teams) {
-            team.wrongSubmissions.clear();
-            team.firstAcceptTime.clear();
-            team.isSolved.clear();
-            team.totalSubmissions.clear();
-            team.frozenSubmissions.clear();
-
-            for (const auto& problem : problemNames) {
-                team.wrongSubmissions[problem] = 0;
-                team.firstAcceptTime[problem] = 0;
-                team.isSolved[problem] = false;
-                team.totalSubmissions[problem] = 0;
-                team.frozenSubmissions[problem] = 0;
-            }
-        }
+        // Size the submission log once from the constraint bounds
+        submissions.reserve(min(MAX_OPERATIONS, teams.size() * problemCount * SUBMISSIONS_PER_CELL));
+
+        // The team set is final from here on, so names can be hashed perfectly
+        vector<TeamName> names;
+        names.reserve(teams.size());
+        for (const Team& team : teams) names.push_back(team.name);
+        registeredTeams.build(names);
 
         competitionStarted = true;
-        cout << "[Info]Competition starts.\n";
+        out << "[Info]Competition starts.\n";
+    }
+
+    // Id of a registered team, or -1 if there is no such team
+    int findTeam(string_view teamName) const {
+        if (!TeamName::fits(teamName)) return -1;
+        TeamName name(teamName);
+
+        int candidate = registeredTeams.candidate(name);
+        if (candidate != -1 && teams[candidate].name == name) return candidate;
+        if (registeredTeams.size() == teams.size()) return -1;
+        return teamIds.find(name);
     }
 
-    void submitProblem(const string& problemName, const string& teamName, const string& statusStr, int time) {
-        Status status = stringToStatus(statusStr);
-        submissions.emplace_back(teamName, problemName, status, time);
+    // Team ids are assigned 0, 1, 2, ... in registration order
+    bool isTeam(int teamId) const {
+        return teamId >= 0 && teamId < static_cast<int>(teams.size());
+    }
 
-        // Always record the submission for query purposes
-        // Only process for scoreboard if competition has started and team exists
-        if (competitionStarted && teams.find(teamName) != teams.end()) {
-            Team& team = teams[teamName];
-            team.totalSubmissions[problemName]++;
+    // Problems are 0 .. problemCount-1; none exist before START
+    bool isProblem(int problem) const {
+        return problem >= 0 && problem < problemCount;
+    }
 
-            if (isFrozen && !team.isSolved[problemName]) {
-                // After freeze, count submissions but don't update solved status
-                team.frozenSubmissions[problemName]++;
-                if (status == Status::ACCEPTED) {
-                    frozenProblems[teamName].insert(problemName);
-                }
-            } else {
-                // Before freeze or already solved problem
-                if (!team.isSolved[problemName]) {
-                    if (status == Status::ACCEPTED) {
-                        team.isSolved[problemName] = true;
-                        team.firstAcceptTime[problemName] = time;
-                        team.solvedCount++;
-                        team.penaltyTime += team.getProblemPenalty(problemName);
-                    } else {
-                        team.wrongSubmissions[problemName]++;
-                    }
-                }
+    // Ingest a run of already resolved submissions, given in input order.
+    // The log is extended once, the counter updates are applied team by team
+    // (each team's submissions keep their relative order), and each team is
+    // marked dirty for the next flush at most once.
+    void submitBatch(const Submission* batch, size_t count) {
+        if (!competitionStarted || count == 0) return;
+
+        int base = static_cast<int>(submissions.size());
+        submissions.insert(submissions.end(), batch, batch + count);
+
+        // Time index and problem chains follow the log order
+        for (int offset = base; offset < static_cast<int>(submissions.size()); ++offset) {
+            Submission& submission = submissions[offset];
+            if (timeIndex.empty() || submission.time > timeIndex.back().time) {
+                timeIndex.push_back({submission.time, offset});
+            } else if (submission.time < timeIndex.back().time) {
+                timeOrdered = false;
             }
+            submission.previousOfProblem = lastOfProblem[submission.problem];
+            lastOfProblem[submission.problem] = offset;
         }
 
-        // No output for SUBMIT command
+        batchOrder.resize(count);
+        for (size_t i = 0; i < count; ++i) batchOrder[i] = static_cast<int>(i);
+        stable_sort(batchOrder.begin(), batchOrder.end(), [batch](int a, int b) {
+            return batch[a].teamId < batch[b].teamId;
+        });
+
+        size_t i = 0;
+        while (i < count) {
+            int teamId = batch[batchOrder[i]].teamId;
+            Team& team = teams[teamId];
+            bool solvedAny = false;
+            bool hadFrozen = team.frozenMask != 0;
+
+            for (; i < count && batch[batchOrder[i]].teamId == teamId; ++i) {
+                const Submission& submission = batch[batchOrder[i]];
+                int problem = submission.problem;
+                team.totalSubmissions[problem]++;
+
+                // Link the entry into the team's chains; the team's entries
+                // are visited in log order
+                int offset = base + batchOrder[i];
+                submissions[offset].previousByTeam = team.lastSubmission;
+                submissions[offset].previousOnProblem = team.lastOnProblem[problem];
+                team.lastSubmission = offset;
+                team.lastOnProblem[problem] = offset;
+
+                // A disqualified team's submissions are only logged
+                if (!team.disqualified && applySubmission(team, submission, isFrozen)) solvedAny = true;
+            }
+
+            if (solvedAny) markDirty(teamId);
+            // An interactive scroll still has to reveal newly frozen teams
+            if (scrollInProgress && !hadFrozen && team.frozenMask != 0) enqueueScroll(teamId);
+        }
     }
 
     void flushScoreboard() {
-        updateRankings();
-        cout << "[Info]Flush scoreboard.\n";
+        // While frozen no team's ranking fields can change, so this is
+        // normally a no-op sort and an unchanged snapshot
+        if (updateRankings() || orderMoved || rankingStale) publishRanking();
+        out << "[Info]Flush scoreboard.\n";
         printScoreboard();
     }
 
     void freezeScoreboard() {
         if (isFrozen) {
-            cout << "[Error]Freeze failed: scoreboard has been frozen.\n";
+            out << "[Error]Freeze failed: scoreboard has been frozen.\n";
             return;
         }
 
         isFrozen = true;
-        cout << "[Info]Freeze scoreboard.\n";
+        freezePeriods.push_back({static_cast<int>(submissions.size()), -1});
+        publishRanking();
+        out << "[Info]Freeze scoreboard.\n";
     }
 
     void scrollScoreboard() {
         if (!isFrozen) {
-            cout << "[Error]Scroll failed: scoreboard has not been frozen.\n";
+            out << "[Error]Scroll failed: scoreboard has not been frozen.\n";
             return;
         }
 
-        cout << "[Info]Scroll scoreboard.\n";
+        out << "[Info]Scroll scoreboard.\n";
 
         // First flush the scoreboard
         updateRankings();
         printScoreboard();
 
-        // Process scroll operation
-        vector<pair<string, string>> rankingChanges;
+        unfreezeAll(true);
 
-        while (true) {
-            // Find the lowest-ranked team with frozen problems
-            string teamToUnfreeze = "";
-            string problemToUnfreeze = "";
-
-            for (int i = teamOrder.size() - 1; i >= 0; --i) {
-                const string& teamName = teamOrder[i];
-                if (!frozenProblems[teamName].empty()) {
-                    teamToUnfreeze = teamName;
-                    // Find the problem with smallest letter
-                    problemToUnfreeze = *frozenProblems[teamName].begin();
-                    for (const auto& problem : frozenProblems[teamName]) {
-                        if (problem < problemToUnfreeze) {
-                            problemToUnfreeze = problem;
-                        }
-                    }
-                    break;
-                }
-            }
+        isFrozen = false;
+        scrollInProgress = false;
+        freezePeriods.back().end = static_cast<int>(submissions.size());
+        publishRanking();
+    }
 
-            if (teamToUnfreeze.empty()) break;
-
-            // Unfreeze the problem
-            Team& team = teams[teamToUnfreeze];
-            frozenProblems[teamToUnfreeze].erase(problemToUnfreeze);
-
-            // Check if this problem was solved during freeze
-            if (team.frozenSubmissions[problemToUnfreeze] > 0) {
-                // Check if any submission during freeze was AC
-                // We need to find the first AC submission during freeze
-                int firstACTime = -1;
-                for (const auto& submission : submissions) {
-                    if (submission.teamName == teamToUnfreeze &&
-                        submission.problemName == problemToUnfreeze &&
-                        submission.status == Status::ACCEPTED &&
-                        submission.time > 0) { // time > 0 indicates after freeze
-                        if (firstACTime == -1 || submission.time < firstACTime) {
-                            firstACTime = submission.time;
-                        }
-                    }
-                }
+    // SCROLL in steps: SCROLL_BEGIN prints what SCROLL prints before the rank
+    // changes, each SCROLL_STEP reveals the next problems and prints the rank
+    // changes they cause, and SCROLL_FINISH reveals the rest and prints the
+    // final board. Together they print exactly what one SCROLL would.
+    void beginScroll() {
+        if (!isFrozen) {
+            out << "[Error]Scroll failed: scoreboard has not been frozen.\n";
+            return;
+        }
+        if (scrollInProgress) {
+            out << "[Error]Scroll begin failed: scroll has begun.\n";
+            return;
+        }
 
-                if (firstACTime != -1) {
-                    // Problem was solved during freeze
-                    team.isSolved[problemToUnfreeze] = true;
-                    team.firstAcceptTime[problemToUnfreeze] = firstACTime;
-                    team.solvedCount++;
-                    team.penaltyTime += team.getProblemPenalty(problemToUnfreeze);
-
-                    // Update rankings and check for changes
-                    vector<string> oldOrder = teamOrder;
-                    updateRankings();
-
-                    // Check if ranking changed
-                    if (oldOrder != teamOrder) {
-                        // Find the team that was replaced
-                        string replacedTeam = "";
-                        for (size_t i = 0; i < oldOrder.size(); ++i) {
-                            if (oldOrder[i] == teamToUnfreeze) {
-                                if (i > 0) replacedTeam = oldOrder[i-1];
-                                break;
-                            }
-                        }
-
-                        if (!replacedTeam.empty()) {
-                            rankingChanges.emplace_back(teamToUnfreeze, replacedTeam);
-                        }
-                    }
-                }
-            }
+        out << "[Info]Scroll scoreboard.\n";
+        updateRankings();
+        printScoreboard();
+
+        buildScrollQueue();
+        scrollInProgress = true;
+    }
 
-            team.frozenSubmissions[problemToUnfreeze] = 0;
+    void stepScroll(int steps) {
+        if (!scrollInProgress) {
+            out << "[Error]Scroll step failed: scroll has not begun.\n";
+            return;
         }
 
-        // Output ranking changes
-        for (const auto& [team1, team2] : rankingChanges) {
-            cout << team1 << " " << team2 << " "
-                 << teams[team1].solvedCount << " "
-                 << teams[team1].penaltyTime << "\n";
+        pair<int, int> change;
+        for (int i = 0; i < steps && scrollStep(change); ++i) {
+            if (change.first != -1) printRankingChange(change.first, change.second);
         }
+        // Readers see each step's order, still marked frozen
+        if (orderMoved) publishRanking();
+    }
 
-        // Output final scoreboard
+    void finishScroll() {
+        if (!scrollInProgress) {
+            out << "[Error]Scroll finish failed: scroll has not begun.\n";
+            return;
+        }
+
+        pair<int, int> change;
+        while (scrollStep(change)) {
+            if (change.first != -1) printRankingChange(change.first, change.second);
+        }
         printScoreboard();
 
         isFrozen = false;
-        frozenProblems.clear();
+        scrollInProgress = false;
+        freezePeriods.back().end = static_cast<int>(submissions.size());
+        publishRanking();
     }
 
-    void queryRanking(const string& teamName) {
-        if (teams.find(teamName) == teams.end()) {
-            cout << "[Error]Query ranking failed: cannot find the team.\n";
+    // Show the standings and rank changes a SCROLL would produce right now,
+    // leaving the frozen scoreboard exactly as it was. Without the rank
+    // changes only the final board is printed, which needs no simulation.
+    void previewScroll(bool withChanges = true) {
+        if (!isFrozen) {
+            out << "[Error]Scroll preview failed: scoreboard has not been frozen.\n";
             return;
         }
 
-        cout << "[Info]Complete query ranking.\n";
-        if (isFrozen) {
-            cout << "[Warning]Scoreboard is frozen. The ranking may be inaccurate until it were scrolled.\n";
-        }
+        out << "[Info]Scroll preview.\n";
 
-        // Find current ranking
-        int ranking = 1;
-        for (const auto& name : teamOrder) {
-            if (name == teamName) {
-                cout << teamName << " NOW AT RANKING " << ranking << "\n";
-                return;
-            }
-            ranking++;
-        }
+        ScrollCheckpoint checkpoint = saveScrollState();
+        updateRankings();
+        unfreezeAll(withChanges);
+        restoreScrollState(checkpoint);
+    }
+
+    // While on, SCROLL also reports every unfreeze step as
+    // "[Trace]team problem solved_delta penalty_delta old_rank new_rank"
+    void setScrollTrace(bool enabled) {
+        scrollTrace = enabled;
+        out << (enabled ? "[Info]Scroll trace on.\n" : "[Info]Scroll trace off.\n");
+    }
+
+    // While on, ADDTEAM also registers teams after START. A late team starts
+    // with every counter at zero, and no other team's state is touched.
+    void setLateRegistration(bool enabled) {
+        lateRegistration = enabled;
+        out << (enabled ? "[Info]Late registration on.\n" : "[Info]Late registration off.\n");
+    }
+
+    // Latest published ranking; safe to call from any thread
+    shared_ptr<const RankingSnapshot> rankingSnapshot() const {
+        return atomic_load(&published);
+    }
+
+    void queryRanking(string_view teamName) {
+        queryRanking(findTeam(teamName));
     }
 
-    void querySubmission(const string& teamName, const string& problemName, const string& statusStr) {
-        if (teams.find(teamName) == teams.end()) {
-            cout << "[Error]Query submission failed: cannot find the team.\n";
+    void queryRanking(int teamId) {
+        if (!isTeam(teamId)) {
+            out << "[Error]Query ranking failed: cannot find the team.\n";
+            return;
+        }
+        if (teams[teamId].disqualified) {
+            out << "[Error]Query ranking failed: team has been disqualified.\n";
             return;
         }
 
-        cout << "[Info]Complete query submission.\n";
+        if (rankingStale) publishRanking();
+        shared_ptr<const RankingSnapshot> snapshot = rankingSnapshot();
+
+        out << "[Info]Complete query ranking.\n";
+        if (snapshot->frozen) {
+            out << "[Warning]Scoreboard is frozen. The ranking may be inaccurate until it were scrolled.\n";
+        }
+
+        // Ranking after the last scoreboard flush
+        out << teams[teamId].name.view() << " NOW AT RANKING " << snapshot->rankOf[teamId] << "\n";
+    }
+
+    void querySubmission(string_view teamName, string_view problemName, string_view statusStr) {
+        int problem = problemName == "ALL" ? ANY : problemName[0] - 'A';
+        int status = statusStr == "ALL" ? ANY : static_cast<int>(stringToStatus(statusStr));
+        querySubmission(findTeam(teamName), problem, status);
+    }
 
-        bool allProblems = (problemName == "ALL");
-        bool allStatuses = (statusStr == "ALL");
+    // problem and status are indices, or ANY to match every value
+    void querySubmission(int teamId, int problem, int status) {
+        if (!isTeam(teamId)) {
+            out << "[Error]Query submission failed: cannot find the team.\n";
+            return;
+        }
 
-        // Find the last matching submission
-        Submission* lastMatch = nullptr;
-        for (auto it = submissions.rbegin(); it != submissions.rend(); ++it) {
+        out << "[Info]Complete query submission.\n";
 
-            if (it->teamName == teamName &&
-                (allProblems || it->problemName == problemName) &&
-                (allStatuses || statusToString(it->status) == statusStr)) {
-                lastMatch = &(*it);
+        // Find the last matching submission, walking back along the team's
+        // chain, or its chain for the problem
+        const Submission* lastMatch = nullptr;
+        for (int at = newestSubmission(teamId, problem); at != -1; at = previousSubmission(at, problem)) {
+            if (status == ANY || static_cast<int>(submissions[at].status) == status) {
+                lastMatch = &submissions[at];
                 break;
             }
         }
 
         if (lastMatch == nullptr) {
-            cout << "Cannot find any submission.\n";
+            out << "Cannot find any submission.\n";
         } else {
-            cout << lastMatch->teamName << " "
-                 << lastMatch->problemName << " "
+            out << teams[lastMatch->teamId].name.view() << " "
+                 << static_cast<char>('A' + lastMatch->problem) << " "
                  << statusToString(lastMatch->status) << " "
                  << lastMatch->time << "\n";
         }
     }
 
-    void endCompetition() {
-        cout << "[Info]Competition ends.\n";
-    }
+    // Change the status of one submission: the team's last one to the
+    // problem made at the given time
+    void rejudgeSubmission(int teamId, int problem, int time, Status status) {
+        if (!canRejudge()) return;
 
-private:
-    void updateRankings() {
-        // Sort teams according to ranking rules
-        sort(teamOrder.begin(), teamOrder.end(), [this](const string& a, const string& b) {
-            const Team& teamA = teams[a];
-            const Team& teamB = teams[b];
-
-            // 1. More solved problems ranks higher
-            if (teamA.solvedCount != teamB.solvedCount) {
-                return teamA.solvedCount > teamB.solvedCount;
+        int found = -1;
+        if (isTeam(teamId)) {
+            for (int at = newestSubmission(teamId, problem); at != -1; at = previousSubmission(at, problem)) {
+                if (submissions[at].time == time) {
+                    found = at;
+                    break;
+                }
             }
+        }
+        if (found == -1) {
+            out << "[Error]Rejudge failed: cannot find the submission.\n";
+            return;
+        }
 
-            // 2. Less penalty time ranks higher
-            if (teamA.penaltyTime != teamB.penaltyTime) {
-                return teamA.penaltyTime < teamB.penaltyTime;
-            }
+        submissions[found].status = status;
+        recomputeCell(teamId, problem);
+        out << "[Info]Rejudge successfully.\n";
+    }
 
-            // 3. Compare solve times in descending order
-            vector<int> timesA = teamA.getSolveTimes();
-            vector<int> timesB = teamB.getSolveTimes();
+    // Change the status of every submission to a problem, or only of those
+    // with status from unless that is ANY. Costs the submissions to the
+    // problem plus the chains of the cells that changed.
+    void rejudgeProblem(int problem, int from, Status status) {
+        if (!canRejudge()) return;
 
-            size_t minSize = min(timesA.size(), timesB.size());
-            for (size_t i = 0; i < minSize; ++i) {
-                if (timesA[i] != timesB[i]) {
-                    return timesA[i] < timesB[i];
-                }
-            }
+        if (!isProblem(problem)) {
+            out << "[Error]Rejudge failed: cannot find the problem.\n";
+            return;
+        }
 
-            // 4. Lexicographic order of team names
-            return a < b;
-        });
+        vector<int> affectedTeams;
+        bool matched = false;
+        for (int at = lastOfProblem[problem]; at != -1; at = submissions[at].previousOfProblem) {
+            Submission& submission = submissions[at];
+            if (from != ANY && static_cast<int>(submission.status) != from) continue;
+            matched = true;
+            if (submission.status == status) continue;
+            submission.status = status;
+            affectedTeams.push_back(submission.teamId);
+        }
+        if (!matched) {
+            out << "[Error]Rejudge failed: cannot find the submission.\n";
+            return;
+        }
+
+        sort(affectedTeams.begin(), affectedTeams.end());
+        affectedTeams.erase(unique(affectedTeams.begin(), affectedTeams.end()), affectedTeams.end());
+        for (int teamId : affectedTeams) recomputeCell(teamId, problem);
+        out << "[Info]Rejudge successfully.\n";
     }
 
-    void printScoreboard() {
+    // Take a team out of the ranking. Its record and submissions stay for
+    // the audit queries, but it is moved below every other team and the
+    // scoreboard stops before the disqualified tail, so the teams after it
+    // move up a rank without being re-sorted or re-rendered.
+    void disqualifyTeam(int teamId) {
+        if (!isTeam(teamId)) {
+            out << "[Error]Disqualify failed: cannot find the team.\n";
+            return;
+        }
+        if (teams[teamId].disqualified) {
+            out << "[Error]Disqualify failed: team has been disqualified.\n";
+            return;
+        }
+        if (scrollInProgress) {
+            out << "[Error]Disqualify failed: scroll in progress.\n";
+            return;
+        }
+
+        Team& team = teams[teamId];
+        team.disqualified = true;
+        team.frozenMask = 0; // nothing left for a scroll to reveal
+        team.refreshRankKey();
+        // Before the first sort the order is registration order, and the
+        // sort puts the team in place
+        if (rankingSorted) {
+            demoteTeam(teamId);
+            orderMoved = true;
+        }
+        disqualifiedCount++;
+        out << "[Info]Disqualify successfully.\n";
+    }
+
+    // A team's submissions, oldest first: all of them or only those to one
+    // problem (problem may be ANY), and only the last count of them unless
+    // count is ANY. Costs the size of the result, not of the log.
+    void queryHistory(int teamId, int problem, int count) {
+        if (!isTeam(teamId)) {
+            out << "[Error]Query history failed: cannot find the team.\n";
+            return;
+        }
+
+        out << "[Info]Complete query history.\n";
+
+        vector<int> history;
+        for (int at = newestSubmission(teamId, problem);
+             at != -1 && (count == ANY || static_cast<int>(history.size()) < count);
+             at = previousSubmission(at, problem)) {
+            history.push_back(at);
+        }
+
+        if (history.empty()) {
+            out << "Cannot find any submission.\n";
+            return;
+        }
+        for (auto at = history.rbegin(); at != history.rend(); ++at) {
+            const Submission& sub = submissions[*at];
+            out << teams[teamId].name.view() << " " << static_cast<char>('A' + sub.problem) << " "
+                << statusToString(sub.status) << " " << sub.time << "\n";
+        }
+    }
+
+    // Every submission with fromTime <= time <= toTime, in log order
+    void queryTimeline(int fromTime, int toTime) {
+        auto [first, last] = logWindow(fromTime, toTime);
+        printTimeline(first, last, fromTime, toTime);
+    }
+
+    // Every submission since the last FREEZE, in log order
+    void queryTimelineSinceFreeze() {
+        if (freezePeriods.empty()) {
+            out << "[Error]Query timeline failed: scoreboard has not been frozen.\n";
+            return;
+        }
+        printTimeline(freezePeriods.back().start, static_cast<int>(submissions.size()), INT_MIN, INT_MAX);
+    }
+
+    // The board as it stood at the given time with nothing frozen: the log
+    // up to that time is replayed into a scratch contest with the same teams
+    void queryScoreboardAt(int time) {
+        out << "[Info]Complete query scoreboard.\n";
+
+        ICPCManagementSystem replay(out);
+        replay.competitionStarted = true;
+        replay.problemCount = problemCount;
+        for (int teamId = 0; teamId < static_cast<int>(teams.size()); ++teamId) {
+            replay.teams.emplace_back(teams[teamId].name);
+            replay.teamOrder.push_back(teamId);
+            replay.rankPos.push_back(teamId);
+            if (teams[teamId].disqualified) {
+                replay.teams.back().disqualified = true;
+                replay.teams.back().refreshRankKey();
+                replay.disqualifiedCount++;
+            }
+        }
+
+        int last = logWindow(INT_MIN, time).second;
+        if (timeOrdered) {
+            replay.submitBatch(submissions.data(), last);
+        } else {
+            vector<Submission> upTo;
+            for (int i = 0; i < last; ++i) {
+                if (submissions[i].time <= time) upTo.push_back(submissions[i]);
+            }
+            replay.submitBatch(upTo.data(), upTo.size());
+        }
+
+        replay.updateRankings();
+        replay.printScoreboard();
+    }
+
+    void endCompetition() {
+        out << "[Info]Competition ends.\n";
+    }
+
+private:
+    // Apply one submission to its team's cell, as made while the board was
+    // frozen or not. Returns true if it solved the problem.
+    bool applySubmission(Team& team, const Submission& submission, bool frozen) {
+        int problem = submission.problem;
+        if (team.isSolved(problem)) return false; // already solved problems are left alone
+
+        if (frozen) {
+            // After freeze, count submissions but don't update solved status
+            team.frozenSubmissions[problem]++;
+            if (submission.status == Status::ACCEPTED) {
+                team.frozenMask |= 1u << problem;
+                if (team.frozenAcceptTime[problem] == 0) {
+                    team.frozenAcceptTime[problem] = submission.time;
+                }
+            }
+            // Only a frozen cell shows the count; others still read -x
+            if (team.frozenMask & (1u << problem)) team.rowStale = true;
+            return false;
+        }
+
+        if (submission.status == Status::ACCEPTED) {
+            team.markSolved(problem, submission.time);
+            return true;
+        }
+        team.wrongSubmissions[problem]++;
+        team.rowStale = true;
+        return false;
+    }
+
+    // Rebuild one (team, problem) cell from scratch by replaying the team's
+    // chain for the problem, with each freeze applied and, if it has been
+    // scrolled since, revealed at the same point in the log as before
+    void recomputeCell(int teamId, int problem) {
+        Team& team = teams[teamId];
+        if (team.isSolved(problem)) team.unmarkSolved(problem);
+        team.wrongSubmissions[problem] = 0;
+        team.frozenSubmissions[problem] = 0;
+        team.frozenAcceptTime[problem] = 0;
+        team.frozenMask &= ~(1u << problem);
+        team.rowStale = true;
+
+        vector<int> chain;
+        for (int at = team.lastOnProblem[problem]; at != -1; at = submissions[at].previousOnProblem) {
+            chain.push_back(at);
+        }
+
+        size_t period = 0;
+        for (auto at = chain.rbegin(); at != chain.rend(); ++at) {
+            // Reveal the freezes scrolled before this submission was made
+            while (period < freezePeriods.size() && freezePeriods[period].end != -1 &&
+                   freezePeriods[period].end <= *at) {
+                if (team.frozenMask & (1u << problem)) unfreezeProblem(teamId, problem);
+                period++;
+            }
+            bool frozen = period < freezePeriods.size() && freezePeriods[period].start <= *at;
+            applySubmission(team, submissions[*at], frozen);
+        }
+        for (; period < freezePeriods.size() && freezePeriods[period].end != -1; ++period) {
+            if (team.frozenMask & (1u << problem)) unfreezeProblem(teamId, problem);
+        }
+        if (team.disqualified) team.frozenMask = 0;
+
+        markDirty(teamId);
+    }
+
+    // A stepped scroll reveals cells in order, so none may change under it
+    bool canRejudge() {
+        if (scrollInProgress) {
+            out << "[Error]Rejudge failed: scroll in progress.\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Head of a team's chain, or of its chain for problem unless that is ANY
+    int newestSubmission(int teamId, int problem) const {
+        if (problem == ANY) return teams[teamId].lastSubmission;
+        if (problem < 0 || problem >= MAX_PROBLEMS) return -1;
+        return teams[teamId].lastOnProblem[problem];
+    }
+
+    // Next entry back along the chain newestSubmission started
+    int previousSubmission(int offset, int problem) const {
+        return problem == ANY ? submissions[offset].previousByTeam : submissions[offset].previousOnProblem;
+    }
+
+    // Log offsets [first, last) holding the submissions made between the two
+    // times, found by binary search on the time index. If times ever went
+    // backwards the index is not trusted and the whole log is returned, so
+    // callers still check each submission's time.
+    pair<int, int> logWindow(int fromTime, int toTime) const {
+        int size = static_cast<int>(submissions.size());
+        if (!timeOrdered) return {0, size};
+
+        auto offsetAt = [&](auto it) { return it == timeIndex.end() ? size : it->offset; };
+        auto first = lower_bound(timeIndex.begin(), timeIndex.end(), fromTime,
+                                 [](const TimeMark& mark, int time) { return mark.time < time; });
+        auto last = upper_bound(first, timeIndex.end(), toTime,
+                                [](int time, const TimeMark& mark) { return time < mark.time; });
+        return {offsetAt(first), max(offsetAt(first), offsetAt(last))};
+    }
+
+    void printTimeline(int first, int last, int fromTime, int toTime) {
+        out << "[Info]Complete query timeline.\n";
+
+        bool found = false;
+        for (int i = first; i < last; ++i) {
+            const Submission& sub = submissions[i];
+            if (sub.time < fromTime || sub.time > toTime) continue;
+            out << teams[sub.teamId].name.view() << " " << static_cast<char>('A' + sub.problem) << " "
+                << statusToString(sub.status) << " " << sub.time << "\n";
+            found = true;
+        }
+        if (!found) out << "Cannot find any submission.\n";
+    }
+
+    // Publish the current ranking order as a new immutable snapshot
+    void publishRanking() {
+        auto snapshot = make_shared<RankingSnapshot>();
+        snapshot->version = ++rankingVersion;
+        snapshot->frozen = isFrozen;
+        // Disqualified teams are left out and keep rank 0. They fill the tail
+        // of teamOrder once it is sorted, but not before the first sort.
+        snapshot->order.reserve(teamOrder.size() - disqualifiedCount);
+        snapshot->rankOf.assign(teams.size(), 0);
+        for (int teamId : teamOrder) {
+            if (teams[teamId].disqualified) continue;
+            snapshot->order.push_back(teamId);
+            snapshot->rankOf[teamId] = static_cast<int>(snapshot->order.size());
+        }
+        atomic_store(&published, shared_ptr<const RankingSnapshot>(move(snapshot)));
+        rankingStale = false;
+        orderMoved = false;
+    }
+
+    // Republish the current snapshot with a late team appended at the end,
+    // leaving every other team's published rank as it was
+    void publishLateTeam(int teamId) {
+        auto snapshot = make_shared<RankingSnapshot>(*rankingSnapshot());
+        snapshot->version = ++rankingVersion;
+        snapshot->order.push_back(teamId);
+        snapshot->rankOf.resize(teams.size());
+        snapshot->rankOf[teamId] = static_cast<int>(snapshot->order.size());
+        atomic_store(&published, shared_ptr<const RankingSnapshot>(move(snapshot)));
+    }
+
+    // Ranking order: true if team a ranks above team b
+    bool ranksHigher(int a, int b) const {
+        // Solved count, penalty, solve times, then name, in one key compare
+        return compareKeys(teams[a].rankKey, teams[b].rankKey) < 0;
+    }
+
+    // Unfreeze every frozen problem and print the final board, preceded by
+    // the rank changes if requested. The final board is just the flushed
+    // board with every frozen outcome applied, so without rank changes all
+    // outcomes are applied in one pass and the board is re-ranked once.
+    void unfreezeAll(bool reportChanges) {
+        if (!reportChanges) {
+            for (int teamId = 0; teamId < static_cast<int>(teams.size()); ++teamId) {
+                while (teams[teamId].frozenMask != 0) {
+                    if (unfreezeProblem(teamId, lowestFrozenProblem(teamId))) markDirty(teamId);
+                }
+            }
+            updateRankings();
+            printScoreboard();
+            return;
+        }
+
+        vector<pair<int, int>> rankingChanges;
+        buildScrollQueue();
+        pair<int, int> change;
+        while (scrollStep(change)) {
+            if (change.first != -1) rankingChanges.push_back(change);
+        }
+
+        // Output ranking changes
+        for (const auto& [team1, team2] : rankingChanges) {
+            printRankingChange(team1, team2);
+        }
+
+        // Output final scoreboard
+        printScoreboard();
+    }
+
+    // scrollQueue is a heap of the teams with frozen problems whose top is
+    // the lowest-ranked of them. Only the team being revealed changes its
+    // ranking fields, so the others never need to be reordered. A problem
+    // only becomes frozen with an Accepted after the freeze, so every step
+    // flips a problem to solved.
+    void buildScrollQueue() {
+        scrollQueue.clear();
+        for (int teamId = 0; teamId < static_cast<int>(teams.size()); ++teamId) {
+            if (teams[teamId].frozenMask != 0) scrollQueue.push_back(teamId);
+        }
+        make_heap(scrollQueue.begin(), scrollQueue.end(), [this](int a, int b) { return ranksHigher(a, b); });
+    }
+
+    void enqueueScroll(int teamId) {
+        scrollQueue.push_back(teamId);
+        push_heap(scrollQueue.begin(), scrollQueue.end(), [this](int a, int b) { return ranksHigher(a, b); });
+    }
+
+    // Reveal the smallest frozen problem of the lowest-ranked team that has
+    // one. Returns false once nothing is left to reveal. change is set to
+    // (team, team it replaced) if the team moved up, else to (-1, -1).
+    bool scrollStep(pair<int, int>& change) {
+        change = {-1, -1};
+        if (scrollQueue.empty()) return false;
+
+        pop_heap(scrollQueue.begin(), scrollQueue.end(), [this](int a, int b) { return ranksHigher(a, b); });
+        int teamToUnfreeze = scrollQueue.back();
+        scrollQueue.pop_back();
+        int problemToUnfreeze = lowestFrozenProblem(teamToUnfreeze);
+
+        const Team& team = teams[teamToUnfreeze];
+        int oldPos = rankPos[teamToUnfreeze];
+        int newPos = oldPos;
+        int solvedBefore = team.solvedCount;
+        int penaltyBefore = team.penaltyTime;
+
+        if (unfreezeProblem(teamToUnfreeze, problemToUnfreeze)) {
+            // Problem was solved during freeze
+            newPos = promoteTeam(teamToUnfreeze);
+            if (newPos < oldPos) {
+                orderMoved = true;
+                // The team that was directly above now sits at oldPos
+                change = {teamToUnfreeze, teamOrder[oldPos]};
+            }
+        }
+
+        if (scrollTrace) {
+            out << "[Trace]" << team.name.view() << " " << static_cast<char>('A' + problemToUnfreeze) << " "
+                << team.solvedCount - solvedBefore << " " << team.penaltyTime - penaltyBefore << " "
+                << oldPos + 1 << " " << newPos + 1 << "\n";
+        }
+
+        if (team.frozenMask != 0) enqueueScroll(teamToUnfreeze);
+        return true;
+    }
+
+    // A rank change line shows the promoted team's totals after the whole
+    // scroll, which are known up front: every frozen problem left is solved
+    void printRankingChange(int team1, int team2) {
+        const Team& team = teams[team1];
+        int solved = team.solvedCount;
+        int penalty = team.penaltyTime;
+        for (uint32_t frozen = team.frozenMask; frozen != 0; frozen &= frozen - 1) {
+            int problem = __builtin_ctz(frozen);
+            if (team.frozenAcceptTime[problem] == 0) continue;
+            solved++;
+            penalty += 20 * team.wrongSubmissions[problem] + team.frozenAcceptTime[problem];
+        }
+        out << team.name.view() << " " << teams[team2].name.view() << " " << solved << " " << penalty << "\n";
+    }
+
+    // State a scroll modifies, saved so that a preview can be undone. Only
+    // the teams with frozen problems are copied, since no other team record
+    // is written during a scroll.
+    struct ScrollCheckpoint {
+        vector<int> teamOrder;
+        vector<int> rankPos;
+        vector<int> dirtyTeams;
+        bool rankingSorted;
+        bool orderMoved;
+        vector<pair<int, Team>> frozenTeams;
+    };
+
+    ScrollCheckpoint saveScrollState() const {
+        ScrollCheckpoint checkpoint;
+        checkpoint.teamOrder.assign(teamOrder.begin(), teamOrder.end());
+        checkpoint.rankPos.assign(rankPos.begin(), rankPos.end());
+        checkpoint.dirtyTeams.assign(dirtyTeams.begin(), dirtyTeams.end());
+        checkpoint.rankingSorted = rankingSorted;
+        checkpoint.orderMoved = orderMoved;
+        for (int teamId = 0; teamId < static_cast<int>(teams.size()); ++teamId) {
+            if (teams[teamId].frozenMask != 0) checkpoint.frozenTeams.emplace_back(teamId, teams[teamId]);
+        }
+        return checkpoint;
+    }
+
+    void restoreScrollState(const ScrollCheckpoint& checkpoint) {
+        teamOrder.assign(checkpoint.teamOrder.begin(), checkpoint.teamOrder.end());
+        rankPos.assign(checkpoint.rankPos.begin(), checkpoint.rankPos.end());
+        dirtyTeams.assign(checkpoint.dirtyTeams.begin(), checkpoint.dirtyTeams.end());
+        for (int teamId : dirtyTeams) teams[teamId].rankingDirty = true;
+        rankingSorted = checkpoint.rankingSorted;
+        orderMoved = checkpoint.orderMoved;
+
+        // The cached rows of these teams show the previewed outcomes
+        for (const auto& [teamId, team] : checkpoint.frozenTeams) {
+            teams[teamId] = team;
+            teams[teamId].rowStale = true;
+        }
+
+        // A preview during an interactive scroll used the queue as well
+        if (scrollInProgress) buildScrollQueue();
+    }
+
+    // Smallest frozen problem of a team that has at least one
+    int lowestFrozenProblem(int teamId) const {
+        return __builtin_ctz(teams[teamId].frozenMask);
+    }
+
+    // Reveal one frozen problem of a team. Returns true if it was solved
+    // during the freeze, in which case the team's totals now include it.
+    bool unfreezeProblem(int teamId, int problem) {
+        Team& team = teams[teamId];
+        team.frozenMask &= ~(1u << problem);
+
+        int acceptTime = team.frozenAcceptTime[problem];
+        team.frozenSubmissions[problem] = 0;
+        team.frozenAcceptTime[problem] = 0;
+        team.rowStale = true;
+        if (acceptTime == 0) return false;
+
+        team.markSolved(problem, acceptTime);
+        return true;
+    }
+
+    // Move a team whose ranking fields just improved up to its new place.
+    // Every other team is unchanged, so the place is found by binary search
+    // among the teams above it. Returns the team's new position.
+    int promoteTeam(int teamId) {
+        auto from = teamOrder.begin() + rankPos[teamId];
+        auto to = partition_point(teamOrder.begin(), from, [&](int other) {
+            return ranksHigher(other, teamId);
+        });
+        rotate(to, from, from + 1);
+        for (auto it = to; it <= from; ++it) {
+            rankPos[*it] = static_cast<int>(it - teamOrder.begin());
+        }
+        return static_cast<int>(to - teamOrder.begin());
+    }
+
+    // Counterpart of promoteTeam for a team whose ranking fields got worse:
+    // the place is found by binary search among the teams below it
+    int demoteTeam(int teamId) {
+        auto from = teamOrder.begin() + rankPos[teamId];
+        auto to = partition_point(from + 1, teamOrder.end(), [&](int other) {
+            return ranksHigher(other, teamId);
+        });
+        rotate(from, from + 1, to);
+        for (auto it = from; it < to; ++it) {
+            rankPos[*it] = static_cast<int>(it - teamOrder.begin());
+        }
+        return static_cast<int>(to - teamOrder.begin()) - 1;
+    }
+
+    // Put a new team in its place among the ranked teams. The place is found
+    // by binary search, but the insert shifts and renumbers every team below
+    // it. Only valid while teamOrder is fully sorted, i.e. no team is dirty.
+    void insertRanked(int teamId) {
+        auto ranked = teamOrder.end() - disqualifiedCount;
+        auto at = partition_point(teamOrder.begin(), ranked, [&](int other) {
+            return ranksHigher(other, teamId);
+        });
+        at = teamOrder.insert(at, teamId);
+        rankPos.push_back(0);
+        for (auto it = at; it != teamOrder.end(); ++it) {
+            rankPos[*it] = static_cast<int>(it - teamOrder.begin());
+        }
+    }
+
+    // Remember that a team's ranking fields changed since the last sort
+    void markDirty(int teamId) {
+        if (teams[teamId].rankingDirty) return;
+        teams[teamId].rankingDirty = true;
+        dirtyTeams.push_back(teamId);
+    }
+
+    // Bring teamOrder and rankPos up to date. Returns false, without touching
+    // either, when no team's ranking fields changed since the last call.
+    bool updateRankings() {
+        auto higher = [this](int a, int b) { return ranksHigher(a, b); };
+
+        if (rankingSorted && dirtyTeams.empty()) return false;
+
+        if (!rankingSorted) {
+            // First flush: order is still registration order
+            sort(teamOrder.begin(), teamOrder.end(), higher);
+            rankingSorted = true;
+        } else if (!dirtyTeams.empty()) {
+            // Teams that did not change keep their relative order, so only the
+            // dirty ones need sorting before they are merged back in
+            cleanOrder.clear();
+            for (int teamId : teamOrder) {
+                if (!teams[teamId].rankingDirty) cleanOrder.push_back(teamId);
+            }
+            sort(dirtyTeams.begin(), dirtyTeams.end(), higher);
+            merge(cleanOrder.begin(), cleanOrder.end(), dirtyTeams.begin(), dirtyTeams.end(),
+                  teamOrder.begin(), higher);
+        }
+
+        for (int teamId : dirtyTeams) teams[teamId].rankingDirty = false;
+        dirtyTeams.clear();
+
         for (size_t i = 0; i < teamOrder.size(); ++i) {
-            const string& teamName = teamOrder[i];
-            const Team& team = teams[teamName];
-
-            cout << teamName << " " << (i + 1) << " "
-                 << team.solvedCount << " " << team.penaltyTime;
-
-            for (const auto& problem : problemNames) {
-                cout << " ";
-
-                if (team.isSolved.at(problem)) {
-                    // Problem solved
-                    int wrongBefore = team.wrongSubmissions.at(problem);
-                    if (wrongBefore == 0) {
-                        cout << "+";
-                    } else {
-                        cout << "+" << wrongBefore;
-                    }
-                } else if (frozenProblems[teamName].count(problem) > 0) {
-                    // Problem is frozen
-                    int wrongBefore = team.wrongSubmissions.at(problem);
-                    int frozenCount = team.frozenSubmissions.at(problem);
-                    if (wrongBefore == 0) {
-                        cout << "0/" << frozenCount;
-                    } else {
-                        cout << "-" << wrongBefore << "/" << frozenCount;
-                    }
+            rankPos[teamOrder[i]] = static_cast<int>(i);
+        }
+        return true;
+    }
+
+    // Print every row. The part after the rank only changes with the team's
+    // own counters, so it is cached per team and re-rendered only for teams
+    // whose rowStale is set; the other rows are copied from the cache.
+    void printScoreboard() {
+        size_t slotBytes = ROW_FIXED_BYTES + problemCount * CELL_MAX_BYTES;
+        if (rowSlotBytes != slotBytes) {
+            // First print, or the problem count changed
+            rowSlotBytes = slotBytes;
+            rowCache.assign(teams.size() * slotBytes, '\0');
+            rowLength.assign(teams.size(), 0);
+            for (Team& team : teams) team.rowStale = true;
+        } else if (rowLength.size() != teams.size()) {
+            // Teams were added; they are stale from the start, the rest keep their rows
+            rowCache.resize(teams.size() * slotBytes);
+            rowLength.resize(teams.size());
+        }
+
+        size_t shown = teamOrder.size() - disqualifiedCount;
+        for (size_t i = 0; i < shown; ++i) {
+            int teamId = teamOrder[i];
+            Team& team = teams[teamId];
+            char* cells = rowCache.data() + teamId * slotBytes;
+            if (team.rowStale) {
+                rowLength[teamId] = static_cast<int>(renderCells(team, cells) - cells);
+                team.rowStale = false;
+            }
+
+            char* begin = out.appendSpace(team.name.size() + INT_MAX_DIGITS + 1 + rowLength[teamId]);
+            char* p = copy(team.name.begin(), team.name.end(), begin);
+            *p++ = ' ';
+            p = to_chars(p, p + INT_MAX_DIGITS, static_cast<int>(i) + 1).ptr;
+            p = copy_n(cells, rowLength[teamId], p);
+            out.trimTo(p);
+        }
+    }
+
+    // Render the part of a scoreboard line after the rank, returning its end.
+    // Cells that are a single character ("+" solved at the first try, "."
+    // untouched) are classified for all problems at once and written from a
+    // table; digits are formatted only for cells with non-zero counts.
+    char* renderCells(const Team& team, char* p) const {
+        *p++ = ' ';
+        p = to_chars(p, p + INT_MAX_DIGITS, team.solvedCount).ptr;
+        *p++ = ' ';
+        p = to_chars(p, p + INT_MAX_DIGITS, team.penaltyTime).ptr;
+
+        uint32_t noWrong = zeroCounts(team.wrongSubmissions.data());
+        uint32_t simple = noWrong & (team.solvedMask | ~team.frozenMask);
+
+        for (int problem = 0; problem < problemCount; ++problem) {
+            *p++ = ' ';
+            uint32_t bit = 1u << problem;
+            int wrongCount = team.wrongSubmissions[problem];
+
+            if (simple & bit) {
+                *p++ = SIMPLE_CELL_GLYPHS[(team.solvedMask & bit) != 0];
+            } else if (team.solvedMask & bit) {
+                // Problem solved after wrong attempts
+                *p++ = '+';
+                p = to_chars(p, p + INT_MAX_DIGITS, wrongCount).ptr;
+            } else if (team.frozenMask & bit) {
+                // Problem is frozen
+                if (wrongCount == 0) {
+                    *p++ = '0';
                 } else {
-                    // Problem not solved and not frozen
-                    int wrongCount = team.wrongSubmissions.at(problem);
-                    if (wrongCount == 0) {
-                        cout << ".";
-                    } else {
-                        cout << "-" << wrongCount;
-                    }
+                    *p++ = '-';
+                    p = to_chars(p, p + INT_MAX_DIGITS, wrongCount).ptr;
                 }
+                *p++ = '/';
+                p = to_chars(p, p + INT_MAX_DIGITS, team.frozenSubmissions[problem]).ptr;
+            } else {
+                // Problem not solved and not frozen
+                *p++ = '-';
+                p = to_chars(p, p + INT_MAX_DIGITS, wrongCount).ptr;
             }
+        }
+
+        *p++ = '\n';
+        return p;
+    }
+};
+
+// Apply the SUBMITs collected so far
+void ingestBatch(ICPCManagementSystem& system, vector<Submission>& batch) {
+    if (batch.empty()) return;
+    system.submitBatch(batch.data(), batch.size());
+    batch.clear();
+}
 
-            cout << "\n";
+// Parse one text command and apply it to a contest. SUBMIT has no output, so
+// consecutive SUBMITs are collected in batch and ingested together right
+// before the next command that could observe them.
+// Returns true once the contest has ended.
+bool executeCommand(ICPCManagementSystem& system, vector<Submission>& batch, string_view line) {
+    Tokenizer tokens(line);
+    string_view command = tokens.next();
+
+    if (command == "SUBMIT") {
+        string_view problemName = tokens.next();
+        tokens.next(); // BY
+        string_view teamName = tokens.next();
+        tokens.next(); // WITH
+        string_view statusStr = tokens.next();
+        tokens.next(); // AT
+        int time = tokens.nextInt();
+
+        int teamId = system.findTeam(teamName);
+        if (teamId != -1) {
+            batch.emplace_back(teamId, problemName[0] - 'A', stringToStatus(statusStr), time);
         }
+        if (batch.size() < SUBMIT_BATCH_LIMIT) return false;
     }
+
+    ingestBatch(system, batch);
+
+    if (command == "ADDTEAM") {
+        system.addTeam(tokens.next());
+    } else if (command == "START") {
+        tokens.next(); // DURATION
+        int duration = tokens.nextInt();
+        tokens.next(); // PROBLEM
+        int problemCount = tokens.nextInt();
+        system.startCompetition(duration, problemCount);
+    } else if (command == "FLUSH") {
+        system.flushScoreboard();
+    } else if (command == "FREEZE") {
+        system.freezeScoreboard();
+    } else if (command == "SCROLL") {
+        system.scrollScoreboard();
+    } else if (command == "SCROLL_BEGIN") {
+        system.beginScroll();
+    } else if (command == "SCROLL_STEP") {
+        int steps = tokens.nextInt();
+        system.stepScroll(steps > 0 ? steps : 1);
+    } else if (command == "SCROLL_FINISH") {
+        system.finishScroll();
+    } else if (command == "SCROLL_PREVIEW") {
+        system.previewScroll(tokens.next() != "BOARD");
+    } else if (command == "SCROLL_TRACE") {
+        system.setScrollTrace(tokens.next() == "ON");
+    } else if (command == "LATE_REGISTRATION") {
+        system.setLateRegistration(tokens.next() == "ON");
+    } else if (command == "QUERY_RANKING") {
+        system.queryRanking(tokens.next());
+    } else if (command == "DISQUALIFY") {
+        system.disqualifyTeam(system.findTeam(tokens.next()));
+    } else if (command == "REJUDGE") {
+        // REJUDGE TEAM team PROBLEM X AT t TO status
+        // REJUDGE PROBLEM X FROM status|ALL TO status
+        if (tokens.next() == "TEAM") {
+            int teamId = system.findTeam(tokens.next());
+            tokens.next(); // PROBLEM
+            int problem = tokens.next()[0] - 'A';
+            tokens.next(); // AT
+            int time = tokens.nextInt();
+            tokens.next(); // TO
+            system.rejudgeSubmission(teamId, problem, time, stringToStatus(tokens.next()));
+        } else {
+            int problem = tokens.next()[0] - 'A';
+            tokens.next(); // FROM
+            string_view from = tokens.next();
+            tokens.next(); // TO
+            system.rejudgeProblem(problem, from == "ALL" ? ANY : static_cast<int>(stringToStatus(from)),
+                                  stringToStatus(tokens.next()));
+        }
+    } else if (command == "QUERY_HISTORY") {
+        // QUERY_HISTORY team WHERE PROBLEM=X AND LAST=n, either may be ALL
+        int teamId = system.findTeam(tokens.next());
+        tokens.next(); // WHERE
+        string_view problemPart = tokens.next();
+        tokens.next(); // AND
+        string_view lastPart = tokens.next();
+
+        int problem = ANY;
+        if (problemPart.substr(0, 8) == "PROBLEM=" && problemPart.substr(8) != "ALL") {
+            problem = problemPart[8] - 'A';
+        }
+
+        int count = ANY;
+        if (lastPart.substr(0, 5) == "LAST=" && lastPart.substr(5) != "ALL") {
+            from_chars(lastPart.data() + 5, lastPart.data() + lastPart.size(), count);
+        }
+
+        system.queryHistory(teamId, problem, count);
+    } else if (command == "QUERY_TIMELINE") {
+        // QUERY_TIMELINE FROM t1 TO t2, or QUERY_TIMELINE SINCE FREEZE
+        if (tokens.next() == "SINCE") {
+            system.queryTimelineSinceFreeze();
+        } else {
+            int fromTime = tokens.nextInt();
+            tokens.next(); // TO
+            system.queryTimeline(fromTime, tokens.nextInt());
+        }
+    } else if (command == "QUERY_SCOREBOARD") {
+        tokens.next(); // AT
+        system.queryScoreboardAt(tokens.nextInt());
+    } else if (command == "QUERY_SUBMISSION") {
+        string_view teamName = tokens.next();
+        tokens.next(); // WHERE
+        string_view problemPart = tokens.next();
+        tokens.next(); // AND
+        string_view statusPart = tokens.next();
+
+        // Extract problem name from "PROBLEM=X"
+        string_view problemName = "ALL";
+        if (problemPart.substr(0, 8) == "PROBLEM=") {
+            problemName = problemPart.substr(8);
+        }
+
+        // Extract status from "STATUS=X"
+        string_view statusStr = "ALL";
+        if (statusPart.substr(0, 7) == "STATUS=") {
+            statusStr = statusPart.substr(7);
+        }
+
+        system.querySubmission(teamName, problemName, statusStr);
+    } else if (command == "END") {
+        system.endCompetition();
+        return true;
+    }
+
+    return false;
+}
+
+// Binary command protocol. Every frame is a varint byte length followed by
+// that many bytes: an opcode and its operands. Integers are unsigned LEB128
+// varints; teams are referred to by id, the 0-based order in which ADDTEAM
+// succeeded; problems are 0-based indices and statuses follow Status.
+//
+//   ADDTEAM           name bytes (rest of the frame)
+//   START             duration varint, problem count byte (at most 26)
+//   SUBMIT            team varint, problem byte, status byte, time varint
+//   FLUSH, FREEZE, SCROLL, END
+//   QUERY_RANKING     team varint
+//   QUERY_SUBMISSION  team varint, problem byte, status byte (0xFF = ALL)
+enum class Opcode : uint8_t {
+    ADDTEAM = 1,
+    START = 2,
+    SUBMIT = 3,
+    FLUSH = 4,
+    FREEZE = 5,
+    SCROLL = 6,
+    QUERY_RANKING = 7,
+    QUERY_SUBMISSION = 8,
+    END = 9
 };
 
-int main() {
-    ICPCManagementSystem system;
-    string line;
+// Filter byte meaning "ALL" in a binary QUERY_SUBMISSION
+const uint8_t BINARY_ANY = 0xFF;
 
-    while (getline(cin, line)) {
-        if (line.empty()) continue;
+// Reads the operands of one binary frame
+class FrameReader {
+public:
+    explicit FrameReader(string_view frame) : rest(frame) {}
 
-        istringstream iss(line);
-        string command;
-        iss >> command;
-
-        if (command == "ADDTEAM") {
-            string teamName;
-            iss >> teamName;
-            system.addTeam(teamName);
-        } else if (command == "START") {
-            string dummy;
-            int duration, problemCount;
-            iss >> dummy >> duration >> dummy >> problemCount;
-            system.startCompetition(duration, problemCount);
-        } else if (command == "SUBMIT") {
-            string problemName, by, teamName, with, statusStr, at;
-            int time;
-            iss >> problemName >> by >> teamName >> with >> statusStr >> at >> time;
-            system.submitProblem(problemName, teamName, statusStr, time);
-        } else if (command == "FLUSH") {
+    uint8_t byte() {
+        if (rest.empty()) return 0;
+        uint8_t value = static_cast<uint8_t>(rest[0]);
+        rest.remove_prefix(1);
+        return value;
+    }
+
+    uint32_t varint() {
+        uint32_t value = 0;
+        for (int shift = 0; !rest.empty() && shift < 35; shift += 7) {
+            uint8_t b = byte();
+            value |= static_cast<uint32_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) break;
+        }
+        return value;
+    }
+
+    string_view remainder() const { return rest; }
+
+private:
+    string_view rest;
+};
+
+// Decode a varint length prefix at the start of data. Returns the number of
+// prefix bytes, or 0 if the prefix is not complete yet.
+size_t decodeFrameLength(string_view data, size_t& length) {
+    length = 0;
+    for (size_t i = 0; i < data.size() && i < 5; ++i) {
+        uint8_t b = static_cast<uint8_t>(data[i]);
+        length |= static_cast<size_t>(b & 0x7F) << (7 * i);
+        if (!(b & 0x80)) return i + 1;
+    }
+    return 0;
+}
+
+void appendVarint(OutputBuffer& out, size_t value) {
+    while (value >= 0x80) {
+        out << static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out << static_cast<char>(value);
+}
+
+// Apply one binary frame to a contest; SUBMITs are batched as in
+// executeCommand. Returns true once the contest has ended.
+bool executeBinaryCommand(ICPCManagementSystem& system, vector<Submission>& batch, string_view frame) {
+    FrameReader reader(frame);
+    Opcode opcode = static_cast<Opcode>(reader.byte());
+
+    if (opcode == Opcode::SUBMIT) {
+        int teamId = static_cast<int>(reader.varint());
+        int problem = reader.byte();
+        uint8_t status = reader.byte();
+        int time = static_cast<int>(reader.varint());
+
+        // Frames naming an unknown team, problem or status are dropped
+        if (system.isTeam(teamId) && system.isProblem(problem) &&
+            status <= static_cast<uint8_t>(Status::TIME_LIMIT_EXCEED)) {
+            batch.emplace_back(teamId, problem, static_cast<Status>(status), time);
+        }
+        if (batch.size() < SUBMIT_BATCH_LIMIT) return false;
+    }
+
+    ingestBatch(system, batch);
+
+    switch (opcode) {
+        case Opcode::ADDTEAM:
+            system.addTeam(reader.remainder());
+            break;
+        case Opcode::START: {
+            int duration = static_cast<int>(reader.varint());
+            int problemCount = reader.byte();
+            if (problemCount <= MAX_PROBLEMS) system.startCompetition(duration, problemCount);
+            break;
+        }
+        case Opcode::FLUSH:
             system.flushScoreboard();
-        } else if (command == "FREEZE") {
+            break;
+        case Opcode::FREEZE:
             system.freezeScoreboard();
-        } else if (command == "SCROLL") {
+            break;
+        case Opcode::SCROLL:
             system.scrollScoreboard();
-        } else if (command == "QUERY_RANKING") {
-            string teamName;
-            iss >> teamName;
-            system.queryRanking(teamName);
-        } else if (command == "QUERY_SUBMISSION") {
-            string teamName, where, problemPart, and_str, statusPart;
-            iss >> teamName >> where >> problemPart >> and_str >> statusPart;
-
-            // Extract problem name from "PROBLEM=X"
-            string problemName = "ALL";
-            if (problemPart.find("PROBLEM=") == 0) {
-                problemName = problemPart.substr(8);
+            break;
+        case Opcode::QUERY_RANKING:
+            system.queryRanking(static_cast<int>(reader.varint()));
+            break;
+        case Opcode::QUERY_SUBMISSION: {
+            int teamId = static_cast<int>(reader.varint());
+            uint8_t problem = reader.byte();
+            uint8_t status = reader.byte();
+            system.querySubmission(teamId, problem == BINARY_ANY ? ANY : problem,
+                                   status == BINARY_ANY ? ANY : status);
+            break;
+        }
+        case Opcode::END:
+            system.endCompetition();
+            return true;
+        default:
+            break;
+    }
+
+    return false;
+}
+
+// Output is handed to stdout in chunks of at least this many bytes
+const size_t OUTPUT_CHUNK_BYTES = 1 << 16;
+
+// Sends output to stdout. In async mode a dedicated thread drains one buffer
+// with write(2) while the engine fills the other. A producer that has a full
+// buffer before the writer is done waits for it, so a slow consumer applies
+// backpressure with at most two buffers in use, and bytes leave in exactly
+// the order they were handed over.
+class OutputWriter {
+public:
+    explicit OutputWriter(bool async) : async(async), closing(false) {
+        if (async) drainer = thread(&OutputWriter::drain, this);
+    }
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    ~OutputWriter() { close(); }
+
+    // Hand over everything in buffer, leaving it empty
+    void write(OutputBuffer& buffer) {
+        if (buffer.empty()) return;
+        if (!async) {
+            buffer.writeTo(stdout);
+            return;
+        }
+
+        unique_lock<mutex> guard(lock);
+        idle.wait(guard, [&] { return inFlight.empty(); });
+        inFlight.swap(buffer);
+        ready.notify_one();
+    }
+
+    // Wait until everything handed over has been written
+    void close() {
+        if (drainer.joinable()) {
+            {
+                lock_guard<mutex> guard(lock);
+                closing = true;
+                ready.notify_one();
             }
+            drainer.join();
+        }
+        fflush(stdout);
+    }
+
+private:
+    void drain() {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            ready.wait(guard, [&] { return closing || !inFlight.empty(); });
+            if (inFlight.empty()) return;
+
+            // The producer does not touch inFlight until it is empty again
+            guard.unlock();
+            writeAll(inFlight.str());
+            guard.lock();
+            inFlight.clear();
+            idle.notify_one();
+        }
+    }
 
-            // Extract status from "STATUS=X"
-            string statusStr = "ALL";
-            if (statusPart.find("STATUS=") == 0) {
-                statusStr = statusPart.substr(7);
+    static void writeAll(string_view data) {
+        while (!data.empty()) {
+            ssize_t written = ::write(STDOUT_FILENO, data.data(), data.size());
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return;
             }
+            data.remove_prefix(written);
+        }
+    }
 
-            system.querySubmission(teamName, problemName, statusStr);
-        } else if (command == "END") {
-            system.endCompetition();
-            break;
+    bool async;
+    bool closing;
+    mutex lock;
+    condition_variable ready; // inFlight has data, or closing
+    condition_variable idle; // inFlight has been written
+    OutputBuffer inFlight;
+    thread drainer;
+};
+
+// Bytes read from stdin at a time in binary mode
+const size_t BINARY_READ_BYTES = 1 << 20;
+// Bytes of a mapped input log prefetched ahead of the parser
+const size_t PREFETCH_BYTES = 4 << 20;
+
+// Split the first complete binary frame off data. Returns the bytes it
+// occupies including the length prefix, or 0 if the frame is incomplete.
+size_t nextFrame(string_view data, string_view& frame) {
+    size_t length = 0;
+    size_t prefix = decodeFrameLength(data, length);
+    if (prefix == 0 || data.size() < prefix + length) return 0;
+    frame = data.substr(prefix, length);
+    return prefix + length;
+}
+
+// One contest with its pending SUBMIT batch, writing to stdout. Responses
+// are raw text, or in framed output mode the same text behind a varint
+// length per command; only the framing is binary.
+class SingleContest {
+public:
+    SingleContest(OutputWriter& writer, bool framedOutput)
+        : response(), out(), system(response), batch(), writer(writer), framedOutput(framedOutput) {}
+
+    // Apply one text line; returns true once the contest has ended
+    bool feedLine(string_view line) {
+        if (line.empty()) return false;
+        return emit(executeCommand(system, batch, line));
+    }
+
+    // Apply one binary frame; returns true once the contest has ended
+    bool feedFrame(string_view frame) {
+        return emit(executeBinaryCommand(system, batch, frame));
+    }
+
+    void finish() { writer.write(out); }
+
+private:
+    bool emit(bool ended) {
+        if (!response.empty()) {
+            if (framedOutput) appendVarint(out, response.size());
+            out << string_view(response.str());
+            response.clear();
         }
+        if (ended || out.size() >= OUTPUT_CHUNK_BYTES) writer.write(out);
+        return ended;
+    }
+
+    OutputBuffer response;
+    OutputBuffer out;
+    ICPCManagementSystem system;
+    vector<Submission> batch;
+    OutputWriter& writer;
+    bool framedOutput;
+};
+
+// Single contest fed with binary frames on stdin
+int runBinaryContest(OutputWriter& writer, bool framedOutput) {
+    SingleContest contest(writer, framedOutput);
+    string input;
+    size_t consumed = 0;
+    bool ended = false;
+    vector<char> chunk(BINARY_READ_BYTES);
+
+    while (!ended) {
+        size_t read = fread(chunk.data(), 1, chunk.size(), stdin);
+        if (read == 0) break;
+        input.erase(0, consumed);
+        input.append(chunk.data(), read);
+        consumed = 0;
+
+        string_view frame;
+        while (!ended) {
+            size_t used = nextFrame(string_view(input).substr(consumed), frame);
+            if (used == 0) break;
+            ended = contest.feedFrame(frame);
+            consumed += used;
+        }
+    }
+
+    contest.finish();
+    return 0;
+}
+
+// Single contest on stdin/stdout, the judge protocol.
+int runSingleContest(OutputWriter& writer, bool framedOutput) {
+    SingleContest contest(writer, framedOutput);
+    string line;
+
+    while (getline(cin, line)) {
+        if (contest.feedLine(line)) break;
     }
 
+    contest.finish();
     return 0;
-}
\ No newline at end of file
+}
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const char* path) : base(nullptr), length(0), readable(false) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return;
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            return;
+        }
+        if (info.st_size == 0) {
+            // An empty file cannot be mapped, but reads as no data
+            readable = true;
+        } else {
+            void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                base = static_cast<char*>(mapping);
+                length = info.st_size;
+                readable = true;
+                madvise(base, length, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (base != nullptr) munmap(base, length);
+    }
+
+    bool valid() const { return readable; }
+    string_view data() const { return string_view(base, length); }
+
+    // Ask the kernel to start reading the window that follows offset
+    void prefetchAfter(size_t offset) {
+        size_t start = (offset / PREFETCH_BYTES + 1) * PREFETCH_BYTES;
+        if (start < length) madvise(base + start, min(PREFETCH_BYTES, length - start), MADV_WILLNEED);
+    }
+
+private:
+    char* base;
+    size_t length;
+    bool readable;
+};
+
+// Single contest replayed from a command log given by path. The log is
+// mapped and parsed in place; while the commands of one window are applied,
+// the next window is already being read in.
+int runMappedContest(OutputWriter& writer, const char* path, bool binaryInput, bool framedOutput) {
+    MappedFile file(path);
+    if (!file.valid()) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    SingleContest contest(writer, framedOutput);
+    string_view input = file.data();
+    size_t position = 0;
+    size_t nextPrefetch = 0;
+    bool ended = false;
+
+    while (!ended && position < input.size()) {
+        if (position >= nextPrefetch) {
+            file.prefetchAfter(position);
+            nextPrefetch = (position / PREFETCH_BYTES + 1) * PREFETCH_BYTES;
+        }
+
+        if (binaryInput) {
+            string_view frame;
+            size_t used = nextFrame(input.substr(position), frame);
+            if (used == 0) break;
+            ended = contest.feedFrame(frame);
+            position += used;
+        } else {
+            size_t lineEnd = input.find('\n', position);
+            if (lineEnd == string_view::npos) lineEnd = input.size();
+            ended = contest.feedLine(input.substr(position, lineEnd - position));
+            position = lineEnd + 1;
+        }
+    }
+
+    contest.finish();
+    return 0;
+}
+
+// A group of contests served by one thread. Contests are created by their
+// first command and torn down after their END. All contests of a shard draw
+// their arenas from one pool, so blocks released by finished contests are
+// reused by new ones without any locking.
+class ContestShard {
+public:
+    ContestShard() : pool(arenaPoolOptions()) {}
+
+    // Run one command for a contest and append its response to out, with
+    // every line prefixed by the contest id.
+    void execute(string_view contestId, string_view command, OutputBuffer& out) {
+        auto it = contests.find(string(contestId));
+        if (it == contests.end()) {
+            it = contests.emplace(string(contestId), make_unique<Contest>(&pool)).first;
+        }
+        Contest& contest = *it->second;
+
+        bool ended = executeCommand(contest.system, contest.batch, command);
+
+        string_view response = contest.out.str();
+        while (!response.empty()) {
+            size_t lineEnd = response.find('\n');
+            size_t length = lineEnd == string_view::npos ? response.size() : lineEnd + 1;
+            out << contestId << ' ' << response.substr(0, length);
+            response.remove_prefix(length);
+        }
+        contest.out.clear();
+
+        if (ended) contests.erase(it);
+    }
+
+private:
+    struct Contest {
+        OutputBuffer out;
+        ICPCManagementSystem system;
+        vector<Submission> batch; // SUBMITs not yet ingested
+
+        explicit Contest(pmr::memory_resource* upstream) : out(), system(out, upstream) {}
+    };
+
+    static pmr::pool_options arenaPoolOptions() {
+        pmr::pool_options options;
+        options.largest_required_pool_block = ARENA_INITIAL_BYTES;
+        return options;
+    }
+
+    pmr::unsynchronized_pool_resource pool; // must outlive the contests
+    unordered_map<string, unique_ptr<Contest>> contests;
+};
+
+// Runs contests on a fixed set of worker threads. Each contest is hashed onto
+// one worker, whose queue is the single writer for that contest, so commands
+// of a contest are applied strictly in order while different contests proceed
+// in parallel. Every command gets a sequence number and responses are written
+// to stdout in input order, whichever worker finishes first.
+class ShardedExecutor {
+public:
+    ShardedExecutor(size_t workerCount, OutputWriter& writer)
+        : nextSequence(0), firstPending(0), writer(writer) {
+        for (size_t i = 0; i < workerCount; ++i) {
+            workers.push_back(make_unique<Worker>());
+        }
+        for (auto& worker : workers) {
+            worker->runner = thread(&ShardedExecutor::runWorker, this, ref(*worker));
+        }
+    }
+
+    ShardedExecutor(const ShardedExecutor&) = delete;
+    ShardedExecutor& operator=(const ShardedExecutor&) = delete;
+
+    ~ShardedExecutor() { finish(); }
+
+    // Queue a command; blocks while the target worker's queue is full
+    void submit(string_view contestId, string_view command) {
+        Worker& worker = *workers[hash<string_view>()(contestId) % workers.size()];
+        unique_lock<mutex> guard(worker.lock);
+        worker.space.wait(guard, [&] { return worker.queue.size() < WORKER_QUEUE_LIMIT; });
+        worker.queue.push_back(Task{nextSequence++, string(contestId), string(command)});
+        worker.ready.notify_one();
+    }
+
+    // Drain all queues, stop the workers and write any remaining output
+    void finish() {
+        for (auto& worker : workers) {
+            lock_guard<mutex> guard(worker->lock);
+            worker->closing = true;
+            worker->ready.notify_one();
+        }
+        for (auto& worker : workers) {
+            if (worker->runner.joinable()) worker->runner.join();
+        }
+        lock_guard<mutex> guard(outputLock);
+        writer.write(out);
+    }
+
+private:
+    // Commands a worker may have queued before the reader blocks
+    static const size_t WORKER_QUEUE_LIMIT = 4096;
+
+    struct Task {
+        uint64_t sequence;
+        string contestId;
+        string command;
+    };
+
+    struct Worker {
+        ContestShard shard;
+        mutex lock;
+        condition_variable ready;
+        condition_variable space;
+        deque<Task> queue;
+        bool closing = false;
+        thread runner;
+    };
+
+    void runWorker(Worker& worker) {
+        OutputBuffer response;
+        while (true) {
+            Task task;
+            {
+                unique_lock<mutex> guard(worker.lock);
+                worker.ready.wait(guard, [&] { return worker.closing || !worker.queue.empty(); });
+                if (worker.queue.empty()) return;
+                task = move(worker.queue.front());
+                worker.queue.pop_front();
+                worker.space.notify_one();
+            }
+
+            worker.shard.execute(task.contestId, task.command, response);
+            publish(task.sequence, response.str());
+            response.clear();
+        }
+    }
+
+    // Hand in the response of one command and write out every response
+    // whose predecessors are all complete
+    void publish(uint64_t sequence, string_view response) {
+        lock_guard<mutex> guard(outputLock);
+        size_t slot = sequence - firstPending;
+        if (pending.size() <= slot) pending.resize(slot + 1);
+        pending[slot] = string(response);
+
+        while (!pending.empty() && pending.front().has_value()) {
+            out << *pending.front();
+            pending.pop_front();
+            ++firstPending;
+        }
+        if (out.size() >= OUTPUT_CHUNK_BYTES) writer.write(out);
+    }
+
+    vector<unique_ptr<Worker>> workers;
+    uint64_t nextSequence; // only touched by the reader thread
+
+    mutex outputLock;
+    deque<optional<string>> pending; // responses from firstPending onwards
+    uint64_t firstPending;
+    OutputBuffer out;
+    OutputWriter& writer;
+};
+
+// Several independent contests in one process. Every input line is
+// "<contest_id> <command>", and every output line is prefixed with the id of
+// the contest that produced it. With more than one thread, contests are
+// spread over a ShardedExecutor; output order is the same either way.
+int runMultiContest(OutputWriter& writer, size_t threadCount) {
+    string line;
+
+    if (threadCount <= 1) {
+        ContestShard shard;
+        OutputBuffer out;
+        while (getline(cin, line)) {
+            Tokenizer tokens(line);
+            string_view contestId = tokens.next();
+            if (contestId.empty()) continue;
+
+            shard.execute(contestId, tokens.remainder(), out);
+            if (out.size() >= OUTPUT_CHUNK_BYTES) writer.write(out);
+        }
+        writer.write(out);
+        return 0;
+    }
+
+    ShardedExecutor executor(threadCount, writer);
+    while (getline(cin, line)) {
+        Tokenizer tokens(line);
+        string_view contestId = tokens.next();
+        if (contestId.empty()) continue;
+
+        executor.submit(contestId, tokens.remainder());
+    }
+    executor.finish();
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    ios::sync_with_stdio(false);
+
+    bool multiContest = false;
+    bool binaryInput = false;
+    bool framedOutput = false;
+    bool asyncOutput = false;
+    size_t threadCount = 1;
+    bool threadsGiven = false;
+    const char* inputPath = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        string_view arg = argv[i];
+        if (arg == "--multi-contest") {
+            multiContest = true;
+        } else if (arg == "--binary") {
+            binaryInput = true;
+        } else if (arg == "--framed-output") {
+            framedOutput = true;
+        } else if (arg == "--async-output") {
+            asyncOutput = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threadCount = max(1, atoi(argv[++i]));
+            threadsGiven = true;
+        } else if (!arg.empty() && arg[0] != '-') {
+            inputPath = argv[i];
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // Multi-contest mode reads text from stdin only, and is the only mode
+    // with worker threads
+    if (multiContest && (inputPath != nullptr || binaryInput || framedOutput)) {
+        fprintf(stderr, "--multi-contest takes no input file, --binary or --framed-output\n");
+        return 1;
+    }
+    if (!multiContest && threadsGiven) {
+        fprintf(stderr, "--threads needs --multi-contest\n");
+        return 1;
+    }
+
+    OutputWriter writer(asyncOutput);
+    if (multiContest) {
+        return runMultiContest(writer, threadCount);
+    }
+    if (inputPath != nullptr) {
+        return runMappedContest(writer, inputPath, binaryInput, framedOutput);
+    }
+    if (binaryInput) {
+        return runBinaryContest(writer, framedOutput);
+    }
+    return runSingleContest(writer, framedOutput);
+}